@@ -0,0 +1,806 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+/*
+ * Micro benchmarks of the Mondrian tree (build with "make bench")
+ *
+ *  deep    : Stream that keeps growing along one dimension. Almost every
+ *            sample lies outside the root block, so new parent nodes are
+ *            inserted close to the root and the tree gets deep.
+ *  chain   : Geometrically growing first feature with alternating labels
+ *            (all other features 0). Produces the deepest trees, limited
+ *            to "max_chain_samples" to keep the features in float range.
+ *  uniform : Samples drawn uniformly from the unit cube (reference).
+ *  concurrent : Prediction throughput of 1, 2, 4, ... reader threads while
+ *            one writer keeps training the tree on the uniform stream
+ *            (optionally with forgetting, so readers also meet halved
+ *            counts and pruned leaves). Then readers classify with a
+ *            forest (MondrianForest::classify) while the writer adds
+ *            new classes.
+ *  drift   : Uniform samples from a cube that moves along the first
+ *            dimension, the label rule flips every "drift_period" samples.
+ *            Learned with and without forgetting (prequential accuracy).
+ *  budget  : Size, training throughput and test accuracy of a forest as a
+ *            function of the lifetime (init_budget), trained on the data
+ *            set of a config file (e.g. KITTI).
+ *  server  : Load generator of a running server (StreamBasedAL_MF --serve):
+ *            closed loop over several connections with a number of requests
+ *            in flight, reports throughput and latency percentiles.
+ *  host    : Many small forests in one ForestHost: the uniform stream is
+ *            spread over the forests, every 4th request of a forest is a
+ *            classify request. Reports throughput and memory per forest.
+ */
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <limits>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <armadillo>
+#include "stream_based_al_tree.hpp"
+#include "stream_based_al_forest.h"
+#include "stream_based_al_host.h"
+#include "stream_based_al_server.h"
+#include "stream_based_al_data.h"
+#include "stream_based_al_hyperparameters.h"
+#include "stream_based_al_latency.h"
+#include "stream_based_al_instrumentation.h"
+
+using namespace std;
+
+/* Maximum number of samples of the "chain" stream */
+const long max_chain_samples = 3000;
+/* Samples between flips of the label rule of the "drift" stream */
+const long drift_period = 5000;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Help function
+ */
+void help() {
+    cout << "Usage: StreamBasedAL_bench <mode> [num_samples] [feature_dim]"
+        << endl;
+    cout << "\t deep    : \t growing stream, parent insertions near the root"
+        << endl;
+    cout << "\t chain   : \t geometric stream with alternating labels "
+        "(at most " << max_chain_samples << " samples)" << endl;
+    cout << "\t uniform : \t uniform samples from the unit cube" << endl;
+    cout << "\t drift   : \t moving cube with flipping labels, with and "
+        "without forgetting (4th argument: half-life, default 1000)" << endl;
+    cout << "\t concurrent : \t readers classify while one writer trains "
+        "(4th argument: maximum number of readers, 5th: half-life of "
+        "forgetting, default 0 = off), then forest readers while new "
+        "classes arrive" << endl;
+    cout << "\t host    : \t many forests sharing one worker pool "
+        "(4th argument: number of forests, 5th: workers)" << endl;
+    cout << "Usage: StreamBasedAL_bench budget <config file> [budget ...]"
+        << endl;
+    cout << "\t budget  : \t forest size, throughput and accuracy per "
+        "init_budget (-1 = infinity)" << endl;
+    cout << "Usage: StreamBasedAL_bench shards <config file> "
+        "[num_shards ...]" << endl;
+    cout << "\t shards  : \t throughput and accuracy of sharded training "
+        "(1 = every tree learns every sample)" << endl;
+    cout << "Usage: StreamBasedAL_bench server <socket> [num_requests] "
+        "[connections] [in_flight] [update_percent]" << endl;
+    cout << "\t server  : \t load generator of StreamBasedAL_MF --serve"
+        << endl;
+}
+
+/*
+ * Settings of the benchmarked tree (defaults of conf/stream_based_al.conf)
+ */
+mondrian_settings bench_settings(int feature_dim) {
+    mondrian_settings settings;
+    settings.num_trees = 1;
+    settings.init_budget = numeric_limits<float>::infinity();
+    settings.discount_factor = 10.0;
+    settings.discount_param = settings.discount_factor * float(feature_dim);
+    settings.decision_prior_hyperparam = 1.0;
+    settings.debug = false;
+    settings.max_samples_in_one_node = 0;
+    settings.confidence_measure = 0;
+    settings.density_exponent = 0.2;
+    settings.validate_interval = 0;
+    settings.memory_budget = 0;
+    settings.forget_half_life = 0;
+    settings.num_shards = 1;
+    settings.shard_mode = 0;
+    return settings;
+}
+
+/*
+ * Generate sample "i_samp" of the benchmark stream
+ */
+Sample next_sample(const string& mode, long i_samp, int feature_dim) {
+    Sample sample;
+    sample.x = arma::fvec(feature_dim);
+    for (int d = 0; d < feature_dim; d++) {
+        sample.x[d] = float(rand()) / RAND_MAX;
+    }
+    if (mode == "deep")
+        sample.x[0] = float(i_samp) * float(i_samp);
+    sample.y = rand() % 2;
+    if (mode == "chain") {
+        sample.x.zeros();
+        sample.x[0] = float(1e-37 * pow(1.05, double(i_samp)));
+        sample.y = i_samp % 2;
+    }
+    if (mode == "drift") {
+        sample.x[0] += float(i_samp) / drift_period;
+        sample.y = int(sample.x[1] > 0.5) ^ int(i_samp / drift_period % 2);
+    }
+    return sample;
+}
+
+/*
+ * Update a single tree with the benchmark stream and report the update
+ * cost per window of samples
+ */
+int run_update_benchmark(const string& mode, long num_samples,
+        int feature_dim) {
+    mondrian_settings settings = bench_settings(feature_dim);
+    MondrianTree tree(settings, feature_dim);
+    srand(1);
+
+    const long num_windows = 10;
+    long window = num_samples / num_windows > 0 ?
+        num_samples / num_windows : 1;
+    cout << "Update benchmark (" << mode << ", " << num_samples <<
+        " samples, " << feature_dim << " dims)" << endl;
+    cout << left << setw(12) << "samples" << setw(12) << "nodes" <<
+        setw(12) << "max depth" << setw(16) << "mean [us]" <<
+        setw(16) << "p99 [us]" << endl;
+    LatencyHistogram latency;
+    for (long i_samp = 0; i_samp < num_samples; i_samp++) {
+        Sample sample = next_sample(mode, i_samp, feature_dim);
+        unsigned long long start_time = monotonic_time_ns();
+        tree.update(sample);
+        latency.record(monotonic_time_ns() - start_time);
+        if ((i_samp + 1) % window == 0 || i_samp + 1 == num_samples) {
+            mondrian_tree_stats stats = tree.get_stats();
+            cout << left << setw(12) << i_samp + 1 << setw(12) <<
+                stats.num_nodes << setw(12) << stats.max_depth() <<
+                setw(16) << latency.mean() / 1e3 << setw(16) <<
+                latency.percentile(99.) / 1e3 << endl;
+            latency.reset();
+        }
+    }
+    if (instrumentation_enabled()) {
+        vector<mondrian_counters> tree_counters(1, tree.counters_);
+        write_counters_json(cout, mode, tree_counters);
+    }
+    return 0;
+}
+
+/*
+ * Learn the drifting stream without and with forgetting and report size,
+ * update cost and prequential accuracy (classify, then learn) per window
+ */
+int run_drift_benchmark(long num_samples, int feature_dim, int half_life) {
+    const long num_windows = 10;
+    long window = num_samples / num_windows > 0 ?
+        num_samples / num_windows : 1;
+    cout << "Drift benchmark (" << num_samples << " samples, " <<
+        feature_dim << " dims, labels flip every " << drift_period <<
+        " samples)" << endl;
+    int half_lives[] = {0, half_life};
+    for (int run = 0; run < 2; run++) {
+        mondrian_settings settings = bench_settings(feature_dim);
+        settings.forget_half_life = half_lives[run];
+        MondrianTree tree(settings, feature_dim);
+        srand(1);
+        cout << "half-life: " << half_lives[run] << (half_lives[run] == 0 ?
+            " (no forgetting)" : "") << endl;
+        cout << left << setw(12) << "samples" << setw(12) << "nodes" <<
+            setw(14) << "memory [kB]" << setw(16) << "mean [us]" <<
+            setw(12) << "accuracy" << endl;
+        LatencyHistogram latency;
+        long num_correct = 0;
+        mondrian_confidence m_conf;
+        for (long i_samp = 0; i_samp < num_samples; i_samp++) {
+            Sample sample = next_sample("drift", i_samp, feature_dim);
+            if (i_samp > 0) {
+                arma::fvec pred_prob(tree.num_classes_, arma::fill::zeros);
+                if (tree.classify(sample, pred_prob, m_conf) == sample.y)
+                    num_correct++;
+            }
+            unsigned long long start_time = monotonic_time_ns();
+            tree.update(sample);
+            latency.record(monotonic_time_ns() - start_time);
+            if ((i_samp + 1) % window == 0 || i_samp + 1 == num_samples) {
+                mondrian_tree_stats stats = tree.get_stats();
+                cout << left << setw(12) << i_samp + 1 << setw(12) <<
+                    stats.num_nodes << setw(14) <<
+                    long(stats.total_bytes() / 1024) << setw(16) <<
+                    latency.mean() / 1e3 << setw(12) <<
+                    float(num_correct) / window << endl;
+                latency.reset();
+                num_correct = 0;
+            }
+        }
+        int num_violations = tree.validate_tree();
+        if (num_violations > 0) {
+            cout << "[ERROR] - " << num_violations <<
+                " violated invariants after the drift benchmark" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Classify "queries" in a loop until "done" is set
+ */
+void run_reader(MondrianTree& tree, const vector<Sample>& queries,
+        const atomic<bool>& done, long& num_predictions) {
+    mondrian_confidence m_conf;
+    long count = 0;
+    while (!done.load()) {
+        Sample sample = queries[count % queries.size()];
+        arma::fvec pred_prob(tree.num_classes_, arma::fill::zeros);
+        tree.classify(sample, pred_prob, m_conf);
+        count++;
+    }
+    num_predictions = count;
+}
+
+/*
+ * Classify "queries" with the forest in a loop until "done" is set
+ */
+void run_forest_reader(MondrianForest& forest, vector<Sample>& queries,
+        const atomic<bool>& done, long& num_predictions) {
+    long count = 0;
+    while (!done.load()) {
+        forest.classify(queries[count % queries.size()]);
+        count++;
+    }
+    num_predictions = count;
+}
+
+/*
+ * Train a tree on the first half of the uniform stream, then measure the
+ * prediction throughput of the readers while the second half is learned
+ */
+int run_concurrent_benchmark(long num_samples, int feature_dim,
+        int max_readers, int half_life) {
+    mondrian_settings settings = bench_settings(feature_dim);
+    settings.forget_half_life = half_life;
+    cout << "Concurrent benchmark (" << num_samples << " samples, " <<
+        feature_dim << " dims)" << endl;
+    cout << left << setw(12) << "readers" << setw(20) << "predictions/s" <<
+        setw(20) << "per reader" << setw(16) << "updates/s" << endl;
+    for (int num_readers = 1; num_readers <= max_readers; num_readers *= 2) {
+        MondrianTree tree(settings, feature_dim);
+        srand(1);
+        long num_warmup = num_samples / 2;
+        for (long i_samp = 0; i_samp < num_warmup; i_samp++) {
+            Sample sample = next_sample("uniform", i_samp, feature_dim);
+            tree.update(sample);
+        }
+        /* rand() is not thread-safe: generate all samples beforehand */
+        vector<Sample> stream;
+        for (long i_samp = num_warmup; i_samp < num_samples; i_samp++)
+            stream.push_back(next_sample("uniform", i_samp, feature_dim));
+        vector<Sample> queries;
+        for (long i_samp = 0; i_samp < 1000; i_samp++)
+            queries.push_back(next_sample("uniform", i_samp, feature_dim));
+
+        atomic<bool> done(false);
+        vector<long> num_predictions(num_readers, 0);
+        vector<thread> readers;
+        unsigned long long start_time = monotonic_time_ns();
+        for (int r = 0; r < num_readers; r++) {
+            readers.push_back(thread(run_reader, ref(tree), cref(queries),
+                                     cref(done), ref(num_predictions[r])));
+        }
+        for (unsigned int i = 0; i < stream.size(); i++)
+            tree.update(stream[i]);
+        done.store(true);
+        for (int r = 0; r < num_readers; r++)
+            readers[r].join();
+        double seconds = (monotonic_time_ns() - start_time) / 1e9;
+
+        long total = 0;
+        for (int r = 0; r < num_readers; r++)
+            total += num_predictions[r];
+        cout << left << setw(12) << num_readers << setw(20) <<
+            long(total / seconds) << setw(20) <<
+            long(total / seconds / num_readers) << setw(16) <<
+            long(stream.size() / seconds) << endl;
+        int num_violations = tree.validate_tree();
+        if (num_violations > 0) {
+            cout << "[ERROR] - " << num_violations <<
+                " violated invariants after concurrent training" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    /*
+     * Forest readers while the writer adds classes: the number of classes
+     * changes between the trees of one prediction
+     */
+    const int num_new_classes = 16;
+    settings.num_trees = 4;
+    MondrianForest forest(settings, feature_dim);
+    srand(1);
+    vector<Sample> stream;
+    for (long i_samp = 0; i_samp < num_samples; i_samp++) {
+        Sample sample = next_sample("uniform", i_samp, feature_dim);
+        /* Classes 0 and 1 first, then one new class every few samples */
+        int num_classes = 2 + int(i_samp * num_new_classes / num_samples);
+        if (i_samp >= num_samples / 2)
+            sample.y = int(i_samp % num_classes);
+        stream.push_back(sample);
+    }
+    long num_warmup = num_samples / 2;
+    for (long i_samp = 0; i_samp < num_warmup; i_samp++)
+        forest.update(stream[i_samp]);
+    vector<Sample> queries(stream.begin(), stream.begin() +
+                           min(num_warmup, 1000L));
+    int num_readers = max_readers;
+    atomic<bool> done(false);
+    vector<long> num_predictions(num_readers, 0);
+    vector<thread> readers;
+    unsigned long long start_time = monotonic_time_ns();
+    for (int r = 0; r < num_readers; r++) {
+        readers.push_back(thread(run_forest_reader, ref(forest), ref(queries),
+                                 cref(done), ref(num_predictions[r])));
+    }
+    for (long i_samp = num_warmup; i_samp < num_samples; i_samp++)
+        forest.update(stream[i_samp]);
+    done.store(true);
+    for (int r = 0; r < num_readers; r++)
+        readers[r].join();
+    double seconds = (monotonic_time_ns() - start_time) / 1e9;
+    long total = 0;
+    for (int r = 0; r < num_readers; r++)
+        total += num_predictions[r];
+    cout << "forest (" << settings.num_trees << " trees, " <<
+        num_new_classes << " new classes), " << num_readers <<
+        " readers: " << long(total / seconds) << " predictions/s" << endl;
+    /* Stops on a violated invariant */
+    forest.validate();
+    return 0;
+}
+
+/*
+ * Spread the uniform stream over "num_forests" forests of a ForestHost
+ * (one tree each) and report the throughput of the requests and the memory
+ * of the forests
+ */
+int run_host_benchmark(long num_samples, int feature_dim, int num_forests,
+        int num_threads) {
+    mondrian_settings settings = bench_settings(feature_dim);
+    cout << "Host benchmark (" << num_samples << " samples, " <<
+        feature_dim << " dims, " << num_forests << " forests, " <<
+        num_threads << " workers)" << endl;
+    ForestHost host(num_threads);
+    vector<string> names;
+    for (int f = 0; f < num_forests; f++) {
+        names.push_back("forest_" + to_string(f));
+        host.add_forest(names.back(), settings, feature_dim);
+    }
+    /* rand() is not thread-safe: generate all samples beforehand */
+    srand(1);
+    vector<Sample> stream;
+    for (long i_samp = 0; i_samp < num_samples; i_samp++)
+        stream.push_back(next_sample("uniform", i_samp, feature_dim));
+
+    atomic<long> num_classified(0);
+    ForestHost::classify_callback done =
+        [&num_classified](const pair<int, float>&) {num_classified++;};
+    long num_updates = 0, num_classifications = 0;
+    unsigned long long start_time = monotonic_time_ns();
+    for (long i_samp = 0; i_samp < num_samples; i_samp++) {
+        const string& name = names[i_samp % num_forests];
+        /* Every 4th request of each forest classifies */
+        if (i_samp / num_forests % 4 == 3) {
+            host.submit_classify(name, stream[i_samp], done);
+            num_classifications++;
+        } else {
+            host.submit_update(name, stream[i_samp]);
+            num_updates++;
+        }
+    }
+    host.wait();
+    double seconds = (monotonic_time_ns() - start_time) / 1e9;
+
+    if (num_classified.load() != num_classifications) {
+        cout << "[ERROR] - " << num_classified.load() << " of " <<
+            num_classifications << " classify requests answered" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "requests/s: " << long(num_samples / seconds) <<
+        "  updates/s: " << long(num_updates / seconds) <<
+        "  classifications/s: " << long(num_classifications / seconds) <<
+        endl;
+    host.print_stats(cout);
+    return 0;
+}
+
+/*
+ * Latencies and errors of one connection of the load generator
+ */
+struct load_result {
+    LatencyHistogram classify_latency;
+    LatencyHistogram update_latency;
+    long num_errors;
+};
+
+/*
+ * Send "num_requests" requests over one connection, keeping "in_flight"
+ * requests outstanding (closed loop)
+ */
+void run_load_connection(const string& socket_path, int feature_dim,
+        long num_requests, int in_flight, int update_percent, int seed,
+        load_result& result) {
+    result.num_errors = 0;
+    ForestClient client;
+    if (!client.connect(socket_path)) {
+        result.num_errors = num_requests;
+        return;
+    }
+    /* rand() is not thread-safe: one generator per connection */
+    mt19937 generator(seed);
+    uniform_real_distribution<float> uniform(0., 1.);
+    vector<char> payload(sizeof(int32_t) + feature_dim * sizeof(float));
+    deque<unsigned long long> send_times;
+    server_response_header header;
+    string response;
+    long num_sent = 0, num_received = 0;
+    while (num_received < num_requests) {
+        while (num_sent < num_requests && num_sent - num_received <
+               in_flight) {
+            arma::fvec x(feature_dim);
+            for (int d = 0; d < feature_dim; d++)
+                x[d] = uniform(generator);
+            bool update = int(generator() % 100) < update_percent;
+            bool ok = false;
+            send_times.push_back(monotonic_time_ns());
+            if (update) {
+                int32_t label = int(x[0] + x[1] > 1.);
+                memcpy(&payload[0], &label, sizeof(label));
+                memcpy(&payload[sizeof(label)], x.memptr(),
+                       feature_dim * sizeof(float));
+                ok = client.send_request(server_update, uint32_t(num_sent),
+                                         &payload[0], payload.size());
+            } else {
+                ok = client.send_request(server_classify_confident,
+                                         uint32_t(num_sent), x.memptr(),
+                                         feature_dim * sizeof(float));
+            }
+            if (!ok) {
+                result.num_errors += num_requests - num_received;
+                return;
+            }
+            num_sent++;
+        }
+        if (!client.receive_response(header, response)) {
+            result.num_errors += num_requests - num_received;
+            return;
+        }
+        /* Responses of a connection arrive in the order of the requests */
+        unsigned long long latency = monotonic_time_ns() -
+            send_times.front();
+        send_times.pop_front();
+        num_received++;
+        if (header.status != server_ok)
+            result.num_errors++;
+        else if (header.op == server_update)
+            result.update_latency.record(latency);
+        else
+            result.classify_latency.record(latency);
+    }
+}
+
+/*
+ * Load generator of a running server: reports throughput and latency
+ * percentiles of classify and update requests
+ */
+int run_server_benchmark(const string& socket_path, long num_requests,
+        int num_connections, int in_flight, int update_percent) {
+    ForestClient client;
+    server_response_header header;
+    string info;
+    if (!client.connect(socket_path) ||
+        !client.send_request(server_info, 0, NULL, 0) ||
+        !client.receive_response(header, info) ||
+        info.size() < 2 * sizeof(int32_t) + sizeof(float)) {
+        cout << "[ERROR] - no server on " << socket_path << endl;
+        return EXIT_FAILURE;
+    }
+    int32_t feature_dim = 0;
+    memcpy(&feature_dim, info.data(), sizeof(feature_dim));
+    client.close();
+    cout << "Server benchmark (" << num_requests << " requests, " <<
+        num_connections << " connections, " << in_flight <<
+        " in flight per connection, " << update_percent << "% updates, " <<
+        feature_dim << " dims)" << endl;
+
+    vector<load_result> results(num_connections);
+    vector<thread> connections;
+    unsigned long long start_time = monotonic_time_ns();
+    for (int c = 0; c < num_connections; c++) {
+        long num_conn_requests = num_requests / num_connections +
+            (c < num_requests % num_connections ? 1 : 0);
+        connections.push_back(thread(run_load_connection, socket_path,
+                                     feature_dim, num_conn_requests,
+                                     in_flight, update_percent, c + 1,
+                                     ref(results[c])));
+    }
+    for (int c = 0; c < num_connections; c++)
+        connections[c].join();
+    double seconds = (monotonic_time_ns() - start_time) / 1e9;
+
+    load_result total;
+    total.num_errors = 0;
+    for (int c = 0; c < num_connections; c++) {
+        total.classify_latency.merge(results[c].classify_latency);
+        total.update_latency.merge(results[c].update_latency);
+        total.num_errors += results[c].num_errors;
+    }
+    cout << "requests/s: " << long(num_requests / seconds) << "  errors: " <<
+        total.num_errors << endl;
+    if (total.classify_latency.count() > 0)
+        total.classify_latency.print(cout, "classify_confident");
+    if (total.update_latency.count() > 0)
+        total.update_latency.print(cout, "update");
+    return total.num_errors > 0 ? EXIT_FAILURE : 0;
+}
+
+/*
+ * Settings of a forest trained on the data set of "hp" (as in main)
+ */
+mondrian_settings forest_settings(const Hyperparameters& hp,
+        int feature_dim, float init_budget) {
+    mondrian_settings settings = bench_settings(feature_dim);
+    settings.num_trees = hp.num_trees_;
+    settings.init_budget = init_budget < 0 ?
+        numeric_limits<float>::infinity() : init_budget;
+    settings.discount_factor = hp.discount_factor_;
+    settings.discount_param = settings.discount_factor * float(feature_dim);
+    settings.decision_prior_hyperparam = hp.decision_prior_hyperparam_;
+    settings.max_samples_in_one_node = hp.max_samples_in_one_node_;
+    settings.confidence_measure = hp.confidence_measure_;
+    settings.density_exponent = hp.density_exponent_;
+    settings.memory_budget = long(hp.memory_budget_) * 1024;
+    settings.forget_half_life = hp.forget_half_life_;
+    settings.num_shards = hp.num_shards_;
+    settings.shard_mode = hp.shard_mode_;
+    return settings;
+}
+
+/*
+ * Train a forest on all training samples of the config file for each
+ * lifetime budget and report its size, the throughput of training and
+ * testing and the test accuracy
+ */
+int run_budget_benchmark(const string& conf_file,
+        const vector<float>& budgets) {
+    Hyperparameters hp(conf_file);
+    if (hp.user_seed_config_ != 0)
+        rng.set_seed(hp.user_seed_config_);
+    DataSet dataset_train(hp.random_, hp.sort_data_, hp.iterative_);
+    DataSet dataset_test;
+    LabelDictionary labels;
+    dataset_train.set_label_dictionary(labels);
+    dataset_test.set_label_dictionary(labels);
+    dataset_train.load(hp.train_data_, hp.train_labels_);
+    dataset_test.load(hp.test_data_, hp.test_labels_);
+    int feature_dim = dataset_train.feature_dim_;
+
+    cout << "Budget benchmark (" << dataset_train.num_samples_ <<
+        " training, " << dataset_test.num_samples_ << " test samples, " <<
+        hp.num_trees_ << " trees)" << endl;
+    cout << left << setw(12) << "budget" << setw(12) << "nodes" <<
+        setw(12) << "max depth" << setw(14) << "memory [kB]" <<
+        setw(16) << "train [1/s]" << setw(16) << "test [1/s]" <<
+        setw(12) << "accuracy" << endl;
+    for (unsigned int i = 0; i < budgets.size(); i++) {
+        mondrian_settings settings = forest_settings(hp, feature_dim,
+                                                     budgets[i]);
+        MondrianForest forest(settings, feature_dim);
+        dataset_train.reset_position();
+        unsigned long long start_time = monotonic_time_ns();
+        for (unsigned int n = 0; n < dataset_train.num_samples_; n++) {
+            Sample sample = dataset_train.get_next_sample();
+            forest.update(sample);
+        }
+        double train_seconds = (monotonic_time_ns() - start_time) / 1e9;
+
+        dataset_test.reset_position();
+        long num_correct = 0;
+        start_time = monotonic_time_ns();
+        for (unsigned int n = 0; n < dataset_test.num_samples_; n++) {
+            Sample sample = dataset_test.get_next_sample();
+            if (forest.classify(sample) == sample.y)
+                num_correct++;
+        }
+        double test_seconds = (monotonic_time_ns() - start_time) / 1e9;
+
+        mondrian_tree_stats stats = forest.get_stats();
+        cout << left << setw(12) << settings.init_budget << setw(12) <<
+            stats.num_nodes << setw(12) << stats.max_depth() <<
+            setw(14) << long(stats.total_bytes() / 1024) << setw(16) <<
+            long(dataset_train.num_samples_ / train_seconds) <<
+            setw(16) << long(dataset_test.num_samples_ / test_seconds) <<
+            setw(12) << float(num_correct) / dataset_test.num_samples_ <<
+            endl;
+    }
+    return 0;
+}
+
+/*
+ * Train a forest on all training samples of the config file with each
+ * number of shards (batches of "batch_size" samples, one worker per shard)
+ * and compare throughput and test accuracy with the unsharded forest
+ */
+int run_shard_benchmark(const string& conf_file,
+        const vector<int>& shard_counts) {
+    const unsigned int batch_size = 256;
+    Hyperparameters hp(conf_file);
+    DataSet dataset_train(hp.random_, hp.sort_data_, hp.iterative_);
+    DataSet dataset_test;
+    LabelDictionary labels;
+    dataset_train.set_label_dictionary(labels);
+    dataset_test.set_label_dictionary(labels);
+    dataset_train.load(hp.train_data_, hp.train_labels_);
+    dataset_test.load(hp.test_data_, hp.test_labels_);
+    int feature_dim = dataset_train.feature_dim_;
+
+    cout << "Shard benchmark (" << dataset_train.num_samples_ <<
+        " training, " << dataset_test.num_samples_ << " test samples, " <<
+        hp.num_trees_ << " trees, " << (hp.shard_mode_ == 1 ? "hashed" :
+        "round robin") << ")" << endl;
+    cout << left << setw(12) << "shards" << setw(12) << "nodes" <<
+        setw(14) << "memory [kB]" << setw(16) << "train [1/s]" <<
+        setw(12) << "speedup" << setw(16) << "test [1/s]" <<
+        setw(12) << "accuracy" << endl;
+    double base_rate = 0;
+    for (unsigned int i = 0; i < shard_counts.size(); i++) {
+        /* Same random numbers for every configuration */
+        if (hp.user_seed_config_ != 0)
+            rng.set_seed(hp.user_seed_config_);
+        mondrian_settings settings = forest_settings(hp, feature_dim,
+                                                     hp.init_budget_);
+        settings.num_shards = shard_counts[i];
+        MondrianForest forest(settings, feature_dim);
+        ThreadPool* pool = NULL;
+        if (forest.get_num_shards() > 1)
+            pool = new ThreadPool(forest.get_num_shards());
+        dataset_train.reset_position();
+        vector<Sample> batch;
+        unsigned long long start_time = monotonic_time_ns();
+        for (unsigned int n = 0; n < dataset_train.num_samples_; n++) {
+            batch.push_back(dataset_train.get_next_sample());
+            if (batch.size() == batch_size ||
+                    n + 1 == dataset_train.num_samples_) {
+                forest.update_batch(batch, pool);
+                batch.clear();
+            }
+        }
+        double train_seconds = (monotonic_time_ns() - start_time) / 1e9;
+        delete pool;
+
+        dataset_test.reset_position();
+        long num_correct = 0;
+        start_time = monotonic_time_ns();
+        for (unsigned int n = 0; n < dataset_test.num_samples_; n++) {
+            Sample sample = dataset_test.get_next_sample();
+            if (forest.classify(sample) == sample.y)
+                num_correct++;
+        }
+        double test_seconds = (monotonic_time_ns() - start_time) / 1e9;
+
+        double train_rate = dataset_train.num_samples_ / train_seconds;
+        if (i == 0)
+            base_rate = train_rate;
+        mondrian_tree_stats stats = forest.get_stats();
+        cout << left << setw(12) << forest.get_num_shards() << setw(12) <<
+            stats.num_nodes << setw(14) << long(stats.total_bytes() / 1024) <<
+            setw(16) << long(train_rate) << setw(12) <<
+            train_rate / base_rate << setw(16) <<
+            long(dataset_test.num_samples_ / test_seconds) << setw(12) <<
+            float(num_correct) / dataset_test.num_samples_ << endl;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        help();
+        return EXIT_FAILURE;
+    }
+    string mode = argv[1];
+    if (mode == "budget") {
+        if (argc < 3) {
+            help();
+            return EXIT_FAILURE;
+        }
+        vector<float> budgets;
+        for (int i = 3; i < argc; i++)
+            budgets.push_back(float(atof(argv[i])));
+        if (budgets.empty()) {
+            const float default_budgets[] = {0.05, 0.1, 0.5, 2, 10, -1};
+            budgets.assign(default_budgets, default_budgets +
+                           sizeof(default_budgets) / sizeof(float));
+        }
+        return run_budget_benchmark(argv[2], budgets);
+    }
+    if (mode == "shards") {
+        if (argc < 3) {
+            help();
+            return EXIT_FAILURE;
+        }
+        vector<int> shard_counts;
+        for (int i = 3; i < argc; i++)
+            shard_counts.push_back(max(1, atoi(argv[i])));
+        if (shard_counts.empty()) {
+            const int default_shard_counts[] = {1, 2, 5, 10};
+            shard_counts.assign(default_shard_counts, default_shard_counts +
+                                sizeof(default_shard_counts) / sizeof(int));
+        }
+        return run_shard_benchmark(argv[2], shard_counts);
+    }
+    if (mode == "server") {
+        if (argc < 3) {
+            help();
+            return EXIT_FAILURE;
+        }
+        long num_requests = argc > 3 ? atol(argv[3]) : 100000;
+        int num_connections = argc > 4 ? atoi(argv[4]) : 4;
+        int in_flight = argc > 5 ? atoi(argv[5]) : 8;
+        int update_percent = argc > 6 ? atoi(argv[6]) : 10;
+        return run_server_benchmark(argv[2], max(1L, num_requests),
+                                    max(1, num_connections),
+                                    max(1, in_flight), update_percent);
+    }
+    long num_samples = argc > 2 ? atol(argv[2]) : 20000;
+    int feature_dim = argc > 3 ? atoi(argv[3]) : 10;
+    if (num_samples <= 0 || feature_dim <= 0) {
+        cout << "[ERROR] - invalid number of samples or feature dimension"
+            << endl;
+        return EXIT_FAILURE;
+    }
+    if (mode == "chain" && num_samples > max_chain_samples)
+        num_samples = max_chain_samples;
+    if (mode == "deep" || mode == "uniform" || mode == "chain")
+        return run_update_benchmark(mode, num_samples, feature_dim);
+    if (mode == "drift") {
+        int half_life = argc > 4 ? atoi(argv[4]) : 1000;
+        return run_drift_benchmark(num_samples, feature_dim,
+                                   max(1, half_life));
+    }
+    if (mode == "concurrent") {
+        int max_readers = argc > 4 ? atoi(argv[4]) :
+            max(1, int(thread::hardware_concurrency()) - 1);
+        int half_life = argc > 5 ? atoi(argv[5]) : 0;
+        return run_concurrent_benchmark(num_samples, feature_dim,
+                                        max_readers, max(0, half_life));
+    }
+    if (mode == "host") {
+        int num_forests = argc > 4 ? atoi(argv[4]) : 1000;
+        int num_threads = argc > 5 ? atoi(argv[5]) :
+            max(1, int(thread::hardware_concurrency()));
+        return run_host_benchmark(num_samples, feature_dim,
+                                  max(1, num_forests), max(1, num_threads));
+    }
+    help();
+    return EXIT_FAILURE;
+}
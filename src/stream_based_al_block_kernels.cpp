@@ -0,0 +1,48 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_block_kernels.h"
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Kernel tables
+ */
+#define BLOCK_KERNELS(D) \
+    {D, &block_extend<D>, &block_sum_range<D>, &block_outside_sum<D>, \
+        &block_outside_distance<D>}
+
+/*
+ * Specialized feature dimensions (60 = features of the KITTI dataset and
+ * of our feature extractor)
+ */
+static const block_kernels specialized_kernels[] = {
+    BLOCK_KERNELS(2),
+    BLOCK_KERNELS(3),
+    BLOCK_KERNELS(8),
+    BLOCK_KERNELS(16),
+    BLOCK_KERNELS(32),
+    BLOCK_KERNELS(60),
+    BLOCK_KERNELS(64)
+};
+
+static const block_kernels generic_kernels = BLOCK_KERNELS(0);
+
+const block_kernels& get_block_kernels(int feature_dim) {
+    int num_specialized = sizeof(specialized_kernels) /
+        sizeof(specialized_kernels[0]);
+    for (int i = 0; i < num_specialized; i++) {
+        if (specialized_kernels[i].dim == feature_dim)
+            return specialized_kernels[i];
+    }
+    return generic_kernels;
+}
@@ -0,0 +1,137 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_BLOCK_KERNELS_H_
+#define STREAM_BASED_AL_BLOCK_KERNELS_H_
+
+#include <math.h>
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Kernels on the boundaries of a Mondrian block
+ *
+ * Every kernel is a template on the feature dimension "D". For D > 0 the
+ * loop length is a compile-time constant, so the compiler unrolls and
+ * vectorizes the loops; D = 0 is the fallback for any other dimension and
+ * uses the runtime length "n". The kernels of one dimension are collected
+ * in a "block_kernels" table that is selected once per block (see
+ * get_block_kernels).
+ */
+
+/**
+ * Alignment of the block boundaries [bytes] and padding of the boundary
+ * arrays [floats]
+ */
+const int block_alignment = 32;
+const int block_padding = block_alignment / sizeof(float);
+
+/**
+ * Loop length of the kernels
+ */
+template<int D>
+inline int kernel_dim(int n) {
+    return D > 0 ? D : n;
+}
+
+/**
+ * Extend block boundaries to include "point" and return the new sum of
+ * the ranges of all dimensions
+ */
+template<int D>
+float block_extend(float* min_block, float* max_block, const float* point,
+        int n) {
+    const int dim = kernel_dim<D>(n);
+    for (int d = 0; d < dim; d++) {
+        min_block[d] = point[d] < min_block[d] ? point[d] : min_block[d];
+        max_block[d] = point[d] > max_block[d] ? point[d] : max_block[d];
+    }
+    float sum_range = 0.;
+    for (int d = 0; d < dim; d++) {
+        sum_range += max_block[d] - min_block[d];
+    }
+    return sum_range;
+}
+
+/**
+ * Sum of the ranges of all dimensions
+ */
+template<int D>
+float block_sum_range(const float* min_block, const float* max_block,
+        int n) {
+    const int dim = kernel_dim<D>(n);
+    float sum_range = 0.;
+    for (int d = 0; d < dim; d++) {
+        sum_range += max_block[d] - min_block[d];
+    }
+    return sum_range;
+}
+
+/**
+ * Linear distance of "point" to the block
+ * (\eta_j(x) = sum_d max(x_d - u_d, 0) + sum_d max(l_d - x_d, 0))
+ */
+template<int D>
+float block_outside_sum(const float* min_block, const float* max_block,
+        const float* point, int n) {
+    const int dim = kernel_dim<D>(n);
+    float sum_upper = 0.;
+    float sum_lower = 0.;
+    for (int d = 0; d < dim; d++) {
+        float upper = point[d] - max_block[d];
+        float lower = min_block[d] - point[d];
+        sum_upper += upper > 0 ? upper : 0;
+        sum_lower += lower > 0 ? lower : 0;
+    }
+    return sum_upper + sum_lower;
+}
+
+/**
+ * Euclidean distance of "point" to the upper plus the distance to the
+ * lower block boundary
+ */
+template<int D>
+float block_outside_distance(const float* min_block, const float* max_block,
+        const float* point, int n) {
+    const int dim = kernel_dim<D>(n);
+    float sq_upper = 0.;
+    float sq_lower = 0.;
+    for (int d = 0; d < dim; d++) {
+        float upper = point[d] - max_block[d];
+        float lower = min_block[d] - point[d];
+        upper = upper > 0 ? upper : 0;
+        lower = lower > 0 ? lower : 0;
+        sq_upper += upper * upper;
+        sq_lower += lower * lower;
+    }
+    return sqrtf(sq_upper) + sqrtf(sq_lower);
+}
+
+/**
+ * Kernels of one feature dimension
+ */
+struct block_kernels {
+    int dim;  /**< Feature dimension (0 = generic kernels) */
+    float (*extend)(float*, float*, const float*, int);
+    float (*sum_range)(const float*, const float*, int);
+    float (*outside_sum)(const float*, const float*, const float*, int);
+    float (*outside_distance)(const float*, const float*, const float*,
+            int);
+};
+
+/**
+ * Returns the kernels specialized for "feature_dim" or the generic kernels
+ * if there is no specialization
+ */
+const block_kernels& get_block_kernels(int feature_dim);
+
+#endif /* STREAM_BASED_AL_BLOCK_KERNELS_H_ */
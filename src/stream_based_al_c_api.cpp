@@ -0,0 +1,262 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include <limits>
+#include <new>
+#include <vector>
+#include "stream_based_al_c_api.h"
+#include "stream_based_al_forest.h"
+#include "stream_based_al_data.h"
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Forest handle (the forest keeps a reference to "settings")
+ */
+struct sbal_forest {
+    mondrian_settings settings;  /**< Settings used by the trees */
+    MondrianForest* forest;  /**< Forest */
+    LabelDictionary labels;  /**< Labels of the caller */
+};
+
+/*
+ * Sample that uses the features of the caller in place (strict auxiliary
+ * memory: the vector can neither be resized nor copied into new memory)
+ */
+static inline Sample wrap_sample(const float* x, int feature_dim, int y) {
+    Sample sample = {arma::fvec(const_cast<float*>(x), feature_dim, false,
+                                true), y};
+    return sample;
+}
+
+/*
+ * Status of the exception that is being handled (no exception may leave
+ * the library: std::bad_alloc, errors of Armadillo, ...)
+ */
+static int exception_status() {
+    try {
+        throw;
+    } catch (const bad_alloc&) {
+        return SBAL_ERROR_MEMORY;
+    } catch (...) {
+        return SBAL_ERROR_INTERNAL;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+int sbal_version(void) {
+    return SBAL_API_VERSION;
+}
+
+void sbal_default_settings(sbal_settings* settings) {
+    if (settings == NULL)
+        return;
+    settings->num_trees = 10;
+    settings->init_budget = -1.0;
+    settings->discount_factor = 10.0;
+    settings->decision_prior_hyperparam = 1.0;
+    settings->max_samples_in_one_node = 0;
+    settings->confidence_measure = 0;
+    settings->density_exponent = 0.2;
+    settings->memory_budget = 0;
+    settings->forget_half_life = 0;
+}
+
+sbal_forest* sbal_forest_create(const sbal_settings* settings,
+        int feature_dim) {
+    if (settings == NULL || feature_dim < 1 || settings->num_trees < 1 ||
+        settings->confidence_measure < 0 || settings->confidence_measure > 3)
+        return NULL;
+    sbal_forest* forest = new (nothrow) sbal_forest;
+    if (forest == NULL)
+        return NULL;
+    forest->forest = NULL;
+    mondrian_settings& mf_settings = forest->settings;
+    mf_settings.num_trees = settings->num_trees;
+    /* Negative budget -> infinite lifetime */
+    mf_settings.init_budget = settings->init_budget < 0 ?
+        numeric_limits<float>::infinity() : settings->init_budget;
+    mf_settings.discount_factor = settings->discount_factor;
+    mf_settings.discount_param = settings->discount_factor *
+        float(feature_dim);
+    mf_settings.decision_prior_hyperparam =
+        settings->decision_prior_hyperparam;
+    mf_settings.debug = false;
+    mf_settings.max_samples_in_one_node = settings->max_samples_in_one_node;
+    mf_settings.confidence_measure = settings->confidence_measure;
+    mf_settings.density_exponent = settings->density_exponent;
+    mf_settings.validate_interval = 0;
+    mf_settings.memory_budget = long(settings->memory_budget);
+    mf_settings.forget_half_life = settings->forget_half_life;
+    mf_settings.num_shards = 1;
+    mf_settings.shard_mode = 0;
+    try {
+        forest->forest = new MondrianForest(forest->settings, feature_dim);
+    } catch (...) {
+        delete forest;
+        return NULL;
+    }
+    return forest;
+}
+
+void sbal_forest_destroy(sbal_forest* forest) {
+    if (forest == NULL)
+        return;
+    delete forest->forest;
+    delete forest;
+}
+
+int sbal_forest_update(sbal_forest* forest, const float* x, int label) {
+    if (forest == NULL || x == NULL)
+        return SBAL_ERROR_ARGUMENT;
+    try {
+        Sample sample = wrap_sample(x, forest->forest->get_feature_dim(),
+                                    forest->labels.to_internal(label));
+        forest->forest->update(sample);
+    } catch (...) {
+        return exception_status();
+    }
+    return SBAL_OK;
+}
+
+int sbal_forest_update_batch(sbal_forest* forest, const float* x,
+        const int* labels, size_t num_samples) {
+    if (forest == NULL || ((x == NULL || labels == NULL) && num_samples > 0))
+        return SBAL_ERROR_ARGUMENT;
+    int feature_dim = forest->forest->get_feature_dim();
+    try {
+        for (size_t i = 0; i < num_samples; i++) {
+            Sample sample = wrap_sample(x + i * feature_dim, feature_dim,
+                                        forest->labels.to_internal(labels[i]));
+            forest->forest->update(sample);
+        }
+    } catch (...) {
+        return exception_status();
+    }
+    return SBAL_OK;
+}
+
+int sbal_forest_classify(sbal_forest* forest, const float* x, int* label,
+        float* confidence) {
+    if (forest == NULL || x == NULL || label == NULL)
+        return SBAL_ERROR_ARGUMENT;
+    pair<int, float> result;
+    try {
+        Sample sample = wrap_sample(x, forest->forest->get_feature_dim(), 0);
+        result = forest->forest->classify_confident(sample);
+    } catch (...) {
+        return exception_status();
+    }
+    *label = forest->labels.to_external(result.first);
+    if (confidence != NULL)
+        *confidence = result.second;
+    return SBAL_OK;
+}
+
+int sbal_forest_classify_batch(sbal_forest* forest, const float* x,
+        size_t num_samples, int* labels, float* confidences) {
+    if (forest == NULL || ((x == NULL || labels == NULL) && num_samples > 0))
+        return SBAL_ERROR_ARGUMENT;
+    if (num_samples == 0)
+        return SBAL_OK;
+    int feature_dim = forest->forest->get_feature_dim();
+    vector<pair<int, float> > predictions;
+    try {
+        vector<Sample> samples;
+        samples.reserve(num_samples);
+        for (size_t i = 0; i < num_samples; i++)
+            samples.push_back(wrap_sample(x + i * feature_dim, feature_dim,
+                                          0));
+        vector<int> classes;
+        forest->forest->classify_batch(samples, classes, predictions);
+    } catch (...) {
+        return exception_status();
+    }
+    for (size_t i = 0; i < num_samples; i++) {
+        labels[i] = forest->labels.to_external(predictions[i].first);
+        if (confidences != NULL)
+            confidences[i] = predictions[i].second;
+    }
+    return SBAL_OK;
+}
+
+int sbal_forest_save(const sbal_forest* forest, const char* filename) {
+    if (forest == NULL || filename == NULL)
+        return SBAL_ERROR_ARGUMENT;
+    try {
+        if (!forest->forest->save(string(filename), &forest->labels))
+            return SBAL_ERROR_IO;
+    } catch (...) {
+        return exception_status();
+    }
+    return SBAL_OK;
+}
+
+sbal_forest* sbal_forest_load(const char* filename) {
+    if (filename == NULL)
+        return NULL;
+    sbal_forest* forest = new (nothrow) sbal_forest;
+    if (forest == NULL)
+        return NULL;
+    try {
+        forest->forest = MondrianForest::load(string(filename),
+                                              forest->settings,
+                                              &forest->labels);
+    } catch (...) {
+        forest->forest = NULL;
+    }
+    if (forest->forest == NULL) {
+        delete forest;
+        return NULL;
+    }
+    /* The library neither validates (prints and exits) nor debugs */
+    forest->settings.debug = false;
+    forest->settings.validate_interval = 0;
+    try {
+        /* Snapshots without labels use the internal classes as labels */
+        if (forest->labels.size() == 0) {
+            for (int k = 0; k < forest->forest->get_num_classes(); k++)
+                forest->labels.to_internal(k);
+        }
+    } catch (...) {
+        delete forest->forest;
+        delete forest;
+        return NULL;
+    }
+    return forest;
+}
+
+int sbal_forest_feature_dim(const sbal_forest* forest) {
+    if (forest == NULL)
+        return -1;
+    return forest->forest->get_feature_dim();
+}
+
+int sbal_forest_num_classes(const sbal_forest* forest) {
+    if (forest == NULL)
+        return -1;
+    return forest->labels.size();
+}
+
+long sbal_forest_num_samples(const sbal_forest* forest) {
+    if (forest == NULL)
+        return -1;
+    return long(forest->forest->get_num_samples());
+}
+
+long sbal_forest_memory_bytes(const sbal_forest* forest) {
+    if (forest == NULL)
+        return -1;
+    return forest->forest->memory_bytes();
+}
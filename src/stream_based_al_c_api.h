@@ -0,0 +1,148 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_C_API_H_
+#define STREAM_BASED_AL_C_API_H_
+
+/*---------------------------------------------------------------------------*/
+/*
+ * C API of the Mondrian forest (libstreambasedal, build with "make lib")
+ *
+ * A forest is an opaque handle. Feature vectors are read in place from the
+ * buffer of the caller (no copies); a batch is a row-major array with one
+ * sample of "feature_dim" floats per row. Labels are arbitrary integers,
+ * they are mapped to the classes of the forest by a label dictionary that
+ * is saved with the forest. Calls on the same forest must not overlap;
+ * different forests may be used from different threads.
+ *
+ * Functions that can fail return SBAL_OK (0) or a negative status code.
+ * No C++ exception leaves the library; an update that fails with
+ * SBAL_ERROR_MEMORY or SBAL_ERROR_INTERNAL may have changed only some of
+ * the trees.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SBAL_API __attribute__((visibility("default")))
+#else
+#define SBAL_API
+#endif
+
+/* Version of the API (incremented on incompatible changes) */
+#define SBAL_API_VERSION 1
+
+/* Status codes */
+#define SBAL_OK 0
+#define SBAL_ERROR_ARGUMENT -1  /* NULL pointer or invalid value */
+#define SBAL_ERROR_IO -2  /* File could not be read or written */
+#define SBAL_ERROR_MEMORY -3  /* Out of memory */
+#define SBAL_ERROR_INTERNAL -4  /* Unexpected error in the library */
+
+/* Opaque forest handle */
+typedef struct sbal_forest sbal_forest;
+
+/*
+ * Settings of a forest (see the Mondrian group of conf/stream_based_al.conf)
+ */
+typedef struct sbal_settings {
+    int num_trees;  /* Number of trees */
+    float init_budget;  /* Lifetime of the trees (< 0 = infinity) */
+    float discount_factor;  /* Discount per feature dimension */
+    float decision_prior_hyperparam;  /* Prior of the decision distribution */
+    int max_samples_in_one_node;  /* Split nodes with more samples (0 = off) */
+    int confidence_measure;  /* 0 = margin, 1 = entropy, 2 = density,
+                                3 = random */
+    float density_exponent;  /* Exponent of the density in the confidence */
+    int64_t memory_budget;  /* Memory ceiling in bytes (0 = unbounded) */
+    int forget_half_life;  /* Halve counts every n samples (0 = off) */
+} sbal_settings;
+
+/*
+ * Version of the library (SBAL_API_VERSION it was built with)
+ */
+SBAL_API int sbal_version(void);
+
+/*
+ * Fill "settings" with the defaults of conf/stream_based_al.conf
+ */
+SBAL_API void sbal_default_settings(sbal_settings* settings);
+
+/*
+ * Create an empty forest for feature vectors of "feature_dim" floats
+ * (returns NULL on invalid arguments or if out of memory)
+ */
+SBAL_API sbal_forest* sbal_forest_create(const sbal_settings* settings,
+        int feature_dim);
+
+/*
+ * Delete a forest (NULL is ignored)
+ */
+SBAL_API void sbal_forest_destroy(sbal_forest* forest);
+
+/*
+ * Learn one sample
+ */
+SBAL_API int sbal_forest_update(sbal_forest* forest, const float* x,
+        int label);
+
+/*
+ * Learn "num_samples" samples (rows of "x") in order
+ */
+SBAL_API int sbal_forest_update_batch(sbal_forest* forest, const float* x,
+        const int* labels, size_t num_samples);
+
+/*
+ * Classify one sample: label and confidence (label -1 and confidence 0
+ * while the forest has not learned any sample; "confidence" may be NULL)
+ */
+SBAL_API int sbal_forest_classify(sbal_forest* forest, const float* x,
+        int* label, float* confidence);
+
+/*
+ * Classify "num_samples" samples (rows of "x") tree by tree into the
+ * buffers "labels" and "confidences" of the caller ("confidences" may be
+ * NULL)
+ */
+SBAL_API int sbal_forest_classify_batch(sbal_forest* forest, const float* x,
+        size_t num_samples, int* labels, float* confidences);
+
+/*
+ * Write the forest and its labels to "filename"
+ */
+SBAL_API int sbal_forest_save(const sbal_forest* forest,
+        const char* filename);
+
+/*
+ * Load a forest written by sbal_forest_save (or a snapshot of the server);
+ * returns NULL if the file cannot be read or if out of memory
+ */
+SBAL_API sbal_forest* sbal_forest_load(const char* filename);
+
+/*
+ * Properties of a forest (-1 for a NULL forest or on error)
+ */
+SBAL_API int sbal_forest_feature_dim(const sbal_forest* forest);
+SBAL_API int sbal_forest_num_classes(const sbal_forest* forest);
+SBAL_API long sbal_forest_num_samples(const sbal_forest* forest);
+SBAL_API long sbal_forest_memory_bytes(const sbal_forest* forest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAM_BASED_AL_C_API_H_ */
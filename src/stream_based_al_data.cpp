@@ -19,6 +19,7 @@
  * Result
  */
 Result::Result() :
+    training_time_(0.0),
     testing_time_(0.0),
     accuracy_(0.0),
     confidence_(20, arma::fill::zeros),
@@ -30,25 +31,58 @@ Result::Result() :
 }
 
 
+/*---------------------------------------------------------------------------*/
+/*
+ * Label dictionary
+ */
+int LabelDictionary::to_internal(int label) {
+    map<int, int>::iterator it = internal_.find(label);
+    if (it != internal_.end())
+        return it->second;
+    int index = int(external_.size());
+    internal_[label] = index;
+    external_.push_back(label);
+    return index;
+}
+
+int LabelDictionary::find(int label) const {
+    map<int, int>::const_iterator it = internal_.find(label);
+    if (it == internal_.end())
+        return -1;
+    return it->second;
+}
+
+bool LabelDictionary::is_identity() const {
+    for (unsigned int i = 0; i < external_.size(); i++) {
+        if (external_[i] != int(i))
+            return false;
+    }
+    return true;
+}
+
 /*---------------------------------------------------------------------------*/
 /*
  * Data set
  */
 DataSet::DataSet() :
+    num_classes_(0),
     random_(false),
     sort_classes_(false),
     load_iterative_(false),
     sample_pos_(0),
-    add_points_(false) {
+    add_points_(false),
+    labels_(&own_labels_) {
 }
 
 DataSet::DataSet(const bool random, const bool sort_classes, 
         const bool load_iterative) :
+    num_classes_(0),
     random_(random),
     sort_classes_(sort_classes),
     load_iterative_(load_iterative),
     sample_pos_(0),
-    add_points_(false) {
+    add_points_(false),
+    labels_(&own_labels_) {
 
 }
 
@@ -156,25 +190,45 @@ void DataSet::load_complete_dataset(const string& x_filename,
     /* Delete list with data points */
     if (!add_points_)
         samples_.clear();
+    unsigned int first_new_sample = (unsigned int) samples_.size();
     set<int> labels;
     /* Going through complete files */
     for (int n_samp = 0; n_samp < num_samples_; n_samp++) {
         Sample sample;
         sample.x = arma::fvec(feature_dim_);
         int tmp_y;
-        assert(yfp >> tmp_y && !yfp.fail()); //check successful read
+        if (!(yfp >> tmp_y)) { //check successful read
+            cout << "[ERROR] - Could not read label of sample " << n_samp <<
+                endl;
+            exit(EXIT_FAILURE);
+        }
         sample.y = tmp_y;
         labels.insert(sample.y);
         for (int n_feat = 0; n_feat < feature_dim_; n_feat++) {
             float tmp_x;
-            assert(xfp >> tmp_x && !xfp.fail()); //check successful read
+            if (!(xfp >> tmp_x)) { //check successful read
+                cout << "[ERROR] - Could not read feature " << n_feat <<
+                    " of sample " << n_samp << endl;
+                exit(EXIT_FAILURE);
+            }
             sample.x(n_feat) = tmp_x;
         }
         samples_.push_back(sample);
     }
     xfp.close();
     yfp.close();
-    num_classes_ = (int) labels.size();
+    /*
+     * Register labels in ascending order (dense labels 0..K-1 keep their
+     * values) and replace them by their internal indices
+     */
+    for (set<int>::iterator it = labels.begin(); it != labels.end(); it++) {
+        labels_->to_internal(*it);
+    }
+    for (unsigned int n_samp = first_new_sample; n_samp < samples_.size();
+            n_samp++) {
+        samples_[n_samp].y = labels_->find(samples_[n_samp].y);
+    }
+    num_classes_ = labels_->size();
 
     if (random_) {
         random_shuffle(samples_.begin(), samples_.end());
@@ -312,9 +366,17 @@ void DataSet::open_position_file(const string& file) {
     }
     int cur_num;
     for (int n_samp = 0; n_samp < num_samples_; n_samp++) {
-        assert(x_num_file >> cur_num);
+        if (!(x_num_file >> cur_num)) {
+            cout << "[ERROR] - Could not read position of sample " <<
+                n_samp << endl;
+            exit(EXIT_FAILURE);
+        }
         x_file_position_.push_back(cur_num);
-        assert(y_num_file >> cur_num);
+        if (!(y_num_file >> cur_num)) {
+            cout << "[ERROR] - Could not read position of label " <<
+                n_samp << endl;
+            exit(EXIT_FAILURE);
+        }
         y_file_position_.push_back(cur_num);
     }
     
@@ -337,8 +399,53 @@ void DataSet::get_sample_from_file(Sample& sample) {
     /* Get current line of file */
     sample.x = arma::fvec(feature_dim_);
     y_file_ >> sample.y;
+    /* Labels are registered in order of appearance */
+    sample.y = labels_->to_internal(sample.y);
+    num_classes_ = labels_->size();
     for (int n_feat = 0; n_feat < feature_dim_; n_feat++) {
         x_file_ >> sample.x(n_feat);
     }
     
 }
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Buffer of the least confident samples
+ */
+UncertaintyBuffer::UncertaintyBuffer(int capacity) :
+    capacity_(capacity > 0 ? capacity : 1),
+    num_inserted_(0) {
+    entries_.reserve(capacity_);
+    samples_.reserve(capacity_);
+}
+
+void UncertaintyBuffer::insert(const Sample& sample, float confidence) {
+    entry cur = {confidence, num_inserted_++, 0};
+    if (int(entries_.size()) < capacity_) {
+        cur.slot = int(entries_.size());
+        if (cur.slot < int(samples_.size()))
+            samples_[cur.slot] = sample;
+        else
+            samples_.push_back(sample);
+        entries_.push_back(cur);
+        push_heap(entries_.begin(), entries_.end());
+        return;
+    }
+    /* Buffer is full: replace the most confident entry */
+    if (!(cur < entries_.front()))
+        return;
+    pop_heap(entries_.begin(), entries_.end());
+    cur.slot = entries_.back().slot;
+    samples_[cur.slot] = sample;
+    entries_.back() = cur;
+    push_heap(entries_.begin(), entries_.end());
+}
+
+void UncertaintyBuffer::sort() {
+    sort_heap(entries_.begin(), entries_.end());
+}
+
+void UncertaintyBuffer::clear() {
+    entries_.clear();
+    num_inserted_ = 0;
+}
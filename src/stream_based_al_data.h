@@ -20,6 +20,7 @@
 #include <vector>
 #include <string.h>
 #include <set>
+#include <map>
 #include <armadillo>  /**< Matrix, vector library */
 #include <algorithm>
 #include "stream_based_al_random.h"
@@ -45,6 +46,7 @@ class Result {
     Result();
     ~Result(){};
     
+    double training_time_;  /**< Save training time */
     double testing_time_;  /**< Save testing time */
     double accuracy_;  /**< Accuracy value of testing data */
     vector<int> result_prediction_;  /**< Save all predictions of a
@@ -72,6 +74,49 @@ class Result {
     float macro_avg_recall_;          /**< average recall over all labels */
 };
 
+/*---------------------------------------------------------------------------*/
+/**
+ * Maps external class labels (arbitrary, possibly sparse integers) to dense
+ * internal indices 0..size()-1 and back
+ *
+ * The Mondrian trees size their histograms by the largest label they see,
+ * so they only work with the dense internal indices. Share one dictionary
+ * between training and testing data to get consistent indices.
+ */
+class LabelDictionary {
+    public:
+        LabelDictionary() {};
+        /**
+         * Return internal index of "label" (registers unknown labels)
+         */
+        int to_internal(int label);
+        /**
+         * Return internal index of "label" or -1 if it is unknown
+         */
+        int find(int label) const;
+        /**
+         * Return external label of internal index (negative indices, e.g.
+         * "no prediction", are returned unchanged)
+         */
+        inline int to_external(int index) const {
+            if (index < 0 || index >= int(external_.size()))
+                return index;
+            return external_[index];
+        };
+        /**
+         * Number of distinct labels
+         */
+        inline int size() const {return int(external_.size());};
+        /**
+         * Returns true if every label equals its internal index
+         */
+        bool is_identity() const;
+
+    private:
+        map<int, int> internal_;  /**< External label -> internal index */
+        vector<int> external_;  /**< Internal index -> external label */
+};
+
 /*---------------------------------------------------------------------------*/
 /**
  * Data set
@@ -101,11 +146,31 @@ class DataSet {
          * Set position of "samples_" back to zero
          */
         inline void reset_position() {sample_pos_ = 0;};
+        /**
+         * Use a shared label dictionary (call before loading the data)
+         */
+        inline void set_label_dictionary(LabelDictionary& labels) {
+            labels_ = &labels;
+        };
+        /**
+         * Return label dictionary of the data set
+         */
+        inline const LabelDictionary& get_label_dictionary() const {
+            return *labels_;
+        };
+        /**
+         * Return external label of an internal label (prediction)
+         */
+        inline int get_external_label(int y) const {
+            return labels_->to_external(y);
+        };
 
         /* Class properties */
         unsigned int num_samples_;  /**< Number of samples in current file */
         int feature_dim_;  /**< Feature dimension */
-        int num_classes_;  /**< Number of classes */
+        int num_classes_;  /**< Number of classes (size of label
+                             dictionary, labels of samples are internal
+                             indices 0..num_classes_-1) */
 
     private:
         /* Properties load data */
@@ -126,6 +191,12 @@ class DataSet {
                                        and y_file_position randomly */
         bool add_points_;  /**< Option to include data points to "samples_"
                              afterwards */
+        LabelDictionary own_labels_;  /**< Default label dictionary */
+        LabelDictionary* labels_;  /**< Label dictionary in use */
+
+        /* "labels_" may point to "own_labels_" of this object (no copies) */
+        DataSet(const DataSet&);
+        DataSet& operator=(const DataSet&);
         /**
          * Load complete dataset into memory
          */
@@ -152,27 +223,61 @@ class DataSet {
 
         
 };
-/*
- * Function inserts current point with decreasing order
- * (depends on buffer.second)
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Buffer of the "capacity" least confident samples of a batch
+ *
+ * The entries are kept in a bounded max-heap on (confidence, arrival), so
+ * an insert costs O(log capacity) and only "capacity" samples are stored.
+ * Among equal confidences the earlier sample is preferred.
  */
-inline void insert_sort(list<pair<Sample, float> >& buffer,
-        pair<Sample, float>& cur_sample) {
-    if (buffer.size() < 1) {
-        buffer.push_back(cur_sample);
-    } else {
-        list<pair<Sample, float> >::iterator it = buffer.begin();
-        bool insert_sample = false;
-        for(; it != buffer.end(); it++) {
-            if ((*it).second > cur_sample.second) {
-                buffer.insert(it, cur_sample);
-                insert_sample = true;
-            }
-            if (insert_sample)
-                break;
-        }
-        if (!insert_sample)
-            buffer.push_back(cur_sample);
-    }
-}
+class UncertaintyBuffer {
+    public:
+        explicit UncertaintyBuffer(int capacity);
+        /**
+         * Insert sample if it is less confident than the most confident
+         * buffered sample (or the buffer is not full)
+         */
+        void insert(const Sample& sample, float confidence);
+        /**
+         * Sort entries by increasing confidence (call before accessing
+         * the entries, invalidates the heap until the next clear())
+         */
+        void sort();
+        /**
+         * Remove all entries (keeps the sample memory)
+         */
+        void clear();
+        /**
+         * Number of buffered samples
+         */
+        inline int size() const {return int(entries_.size());};
+        /**
+         * Sample and confidence of the i-th entry
+         */
+        inline Sample& sample(int i) {
+            return samples_[entries_[i].slot];
+        };
+        inline float confidence(int i) const {
+            return entries_[i].confidence;
+        };
+
+    private:
+        struct entry {
+            float confidence;  /**< Confidence of the prediction */
+            long arrival;  /**< Insertion order (breaks ties) */
+            int slot;  /**< Index in samples_ */
+            bool operator<(const entry& other) const {
+                return confidence < other.confidence ||
+                    (confidence == other.confidence &&
+                     arrival < other.arrival);
+            };
+        };
+
+        int capacity_;  /**< Maximum number of samples */
+        long num_inserted_;  /**< Inserted samples since clear() */
+        vector<entry> entries_;  /**< Max-heap of the entries */
+        vector<Sample> samples_;  /**< Sample storage (one slot per entry) */
+};
 #endif /* STREAM_BASED_AL_DATA_H_ */
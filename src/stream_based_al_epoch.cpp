@@ -0,0 +1,204 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include <iostream>
+#include <thread>
+#include <assert.h>
+#include "stream_based_al_epoch.h"
+
+EpochManager epoch_manager;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reader slot and nesting depth of the current thread (the slot is
+ * released when the thread exits), and whether its running update changes
+ * objects in place
+ */
+struct epoch_registration {
+    EpochManager::reader_slot* slot;
+    int depth;
+    bool in_place;
+    epoch_registration() : slot(NULL), depth(0), in_place(false) {};
+    ~epoch_registration();
+};
+
+static thread_local epoch_registration registration;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Epoch manager
+ */
+EpochManager::slot_block::slot_block() :
+    num_used(0),
+    next(NULL) {
+    for (int i = 0; i < slots_per_block; i++) {
+        slots[i].epoch.store(0);
+        slots[i].in_use.store(false);
+    }
+}
+
+EpochManager::EpochManager() :
+    global_epoch_(1),
+    num_readers_(0),
+    num_in_place_(0),
+    num_retired_(0) {
+}
+
+EpochManager::~EpochManager() {
+    for (unsigned int i = 0; i < retired_.size(); i++) {
+        retired_[i].deleter(retired_[i].ptr);
+    }
+    retired_.clear();
+    slot_block* block = slots_.next.load();
+    while (block != NULL) {
+        slot_block* next = block->next.load();
+        delete block;
+        block = next;
+    }
+}
+
+EpochManager::reader_slot* EpochManager::acquire_slot() {
+    /* Updates that check for readers from now on publish copies */
+    num_readers_.fetch_add(1);
+    int num_own = registration.in_place ? 1 : 0;
+    while (num_in_place_.load() > num_own)
+        this_thread::yield();
+    slot_block* block = &slots_;
+    while (true) {
+        for (int i = 0; i < slots_per_block; i++) {
+            reader_slot& slot = block->slots[i];
+            bool expected = false;
+            if (!slot.in_use.load(memory_order_relaxed) &&
+                slot.in_use.compare_exchange_strong(expected, true)) {
+                int num_used = block->num_used.load();
+                while (num_used < i + 1 &&
+                       !block->num_used.compare_exchange_weak(num_used,
+                                                              i + 1)) {
+                }
+                return &slot;
+            }
+        }
+        /* All slots are used: link a new block (blocks are never freed) */
+        slot_block* next = block->next.load();
+        if (next == NULL) {
+            slot_block* new_block = new slot_block;
+            if (block->next.compare_exchange_strong(next, new_block))
+                next = new_block;
+            else
+                delete new_block;
+        }
+        block = next;
+    }
+}
+
+void EpochManager::release_slot(reader_slot* slot) {
+    slot->epoch.store(0);
+    slot->in_use.store(false);
+    num_readers_.fetch_sub(1);
+}
+
+epoch_registration::~epoch_registration() {
+    if (slot != NULL)
+        epoch_manager.release_slot(slot);
+}
+
+void EpochManager::enter() {
+    if (registration.depth++ > 0)
+        return;
+    if (registration.slot == NULL)
+        registration.slot = acquire_slot();
+    /* Pin the current epoch before any link of the tree is read */
+    registration.slot->epoch.store(global_epoch_.load());
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void EpochManager::exit() {
+    if (--registration.depth > 0)
+        return;
+    registration.slot->epoch.store(0, memory_order_release);
+}
+
+void EpochManager::begin_update() {
+    assert(!registration.in_place && registration.depth == 0);
+    /*
+     * Counterpart of acquire_slot: either this update sees the new reader
+     * or the reader waits until the update has finished
+     */
+    num_in_place_.fetch_add(1);
+    int num_own = registration.slot != NULL ? 1 : 0;
+    if (num_readers_.load() > num_own) {
+        num_in_place_.fetch_sub(1);
+        return;
+    }
+    registration.in_place = true;
+}
+
+void EpochManager::end_update() {
+    if (!registration.in_place)
+        return;
+    registration.in_place = false;
+    num_in_place_.fetch_sub(1);
+}
+
+bool EpochManager::in_place() const {
+    return registration.in_place;
+}
+
+void EpochManager::retire(void* ptr, void (*deleter)(void*)) {
+    retired_object object = {ptr, deleter, global_epoch_.load()};
+    unique_lock<mutex> lock(retired_mutex_);
+    retired_.push_back(object);
+    num_retired_.store(long(retired_.size()), memory_order_relaxed);
+}
+
+void EpochManager::collect() {
+    /* Nothing retired (the usual case of an in-place update) */
+    if (num_retired_.load(memory_order_relaxed) == 0)
+        return;
+    unique_lock<mutex> lock(retired_mutex_);
+    if (retired_.empty())
+        return;
+    unsigned int num_kept = 0;
+    if (registration.in_place) {
+        /* No other thread is registered as reader */
+        for (unsigned int i = 0; i < retired_.size(); i++)
+            retired_[i].deleter(retired_[i].ptr);
+    } else {
+        /* Readers entering from now on cannot reach the retired objects */
+        unsigned long safe_epoch = global_epoch_.fetch_add(1) + 1;
+        atomic_thread_fence(memory_order_seq_cst);
+        for (slot_block* block = &slots_; block != NULL;
+             block = block->next.load()) {
+            int num_used = block->num_used.load();
+            for (int i = 0; i < num_used; i++) {
+                unsigned long epoch = block->slots[i].epoch.load();
+                if (epoch != 0 && epoch < safe_epoch)
+                    safe_epoch = epoch;
+            }
+        }
+        /* Free objects retired before the oldest active reader entered */
+        for (unsigned int i = 0; i < retired_.size(); i++) {
+            if (retired_[i].epoch < safe_epoch)
+                retired_[i].deleter(retired_[i].ptr);
+            else
+                retired_[num_kept++] = retired_[i];
+        }
+    }
+    retired_.resize(num_kept);
+    num_retired_.store(long(num_kept), memory_order_relaxed);
+}
+
+long EpochManager::num_retired() {
+    unique_lock<mutex> lock(retired_mutex_);
+    return long(retired_.size());
+}
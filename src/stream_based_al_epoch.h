@@ -0,0 +1,221 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_EPOCH_H_
+#define STREAM_BASED_AL_EPOCH_H_
+
+#include <stdlib.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Epoch-based reclamation
+ *
+ * Predictions may run on other threads while a Mondrian tree is updated.
+ * Readers enter a read-side critical section with an EpochGuard and follow
+ * the links of the tree without locks. The writer publishes every new node
+ * and buffer completely initialized through an atomic pointer, and never
+ * frees memory that was reachable by readers: replaced objects are handed
+ * to epoch_manager.retire() and freed by collect() once every reader that
+ * was active at that time has left its critical section.
+ *
+ * A thread registers as reader on its first critical section. While no
+ * other thread is registered, an update (begin_update/end_update) changes
+ * posteriors and boundaries in place and frees retired objects at once, so
+ * sequential training does not pay for the copies.
+ */
+
+/**
+ * Pointer that is published with release and read with acquire semantics
+ *
+ * Behaves like a raw pointer (dereference, comparison, assignment), so the
+ * links of the tree keep their usual syntax.
+ */
+template<typename T>
+class atomic_ptr {
+    public:
+        atomic_ptr(T* ptr = NULL) : ptr_(ptr) {};
+        inline T* load() const {return ptr_.load(memory_order_acquire);};
+        inline operator T*() const {return load();};
+        inline T* operator->() const {return load();};
+        inline atomic_ptr& operator=(T* ptr) {
+            ptr_.store(ptr, memory_order_release);
+            return *this;
+        };
+        inline atomic_ptr& operator=(const atomic_ptr& other) {
+            return *this = other.load();
+        };
+
+    private:
+        atomic_ptr(const atomic_ptr&);
+        atomic<T*> ptr_;
+};
+
+/**
+ * Value of a node or tree that readers load while the writer changes it
+ *
+ * Loads and stores are relaxed atomics: a reader always sees a value that
+ * was written completely, but not necessarily together with the values
+ * written next to it (e.g. the count and the total of a histogram). On
+ * x86 they compile to plain moves. The arithmetic assignments are a load
+ * and a store, which is sufficient for the single writer of a tree.
+ */
+template<typename T>
+class relaxed {
+    public:
+        relaxed(T value = T()) : value_(value) {};
+        relaxed(const relaxed& other) : value_(other.load()) {};
+        inline T load() const {return value_.load(memory_order_relaxed);};
+        inline operator T() const {return load();};
+        inline relaxed& operator=(T value) {
+            value_.store(value, memory_order_relaxed);
+            return *this;
+        };
+        inline relaxed& operator=(const relaxed& other) {
+            return *this = other.load();
+        };
+        inline relaxed& operator+=(T value) {return *this = load() + value;};
+        inline relaxed& operator-=(T value) {return *this = load() - value;};
+        inline relaxed& operator++() {return *this += T(1);};
+        inline relaxed& operator--() {return *this -= T(1);};
+        inline T operator++(int) {
+            T value = load();
+            *this = value + T(1);
+            return value;
+        };
+
+    private:
+        atomic<T> value_;
+};
+
+/**
+ * Global and reader epochs, and the objects waiting to be freed
+ */
+class EpochManager {
+    public:
+        static const int slots_per_block = 256;  /**< Reader slots allocated
+                                                   at a time */
+
+        EpochManager();
+        /**
+         * Frees all retired objects (no readers may be active)
+         */
+        ~EpochManager();
+        /**
+         * Enter a read-side critical section (nested calls are allowed)
+         */
+        void enter();
+        /**
+         * Leave a read-side critical section
+         */
+        void exit();
+        /**
+         * Free "ptr" with "deleter" once no reader can reference it
+         */
+        void retire(void* ptr, void (*deleter)(void*));
+        template<typename T>
+        inline void retire(T* ptr) {
+            if (ptr != NULL)
+                retire(static_cast<void*>(ptr), &delete_object<T>);
+        };
+        /**
+         * Advance the global epoch and free all retired objects that no
+         * active reader can reference (called by writers)
+         */
+        void collect();
+        /**
+         * Number of objects waiting to be freed
+         */
+        long num_retired();
+        /**
+         * Start an update (called by writers). If no other thread is
+         * registered as reader, the update may change shared objects in
+         * place instead of publishing copies (in_place() is true until
+         * end_update()). Threads that register as readers meanwhile wait
+         * for end_update().
+         */
+        void begin_update();
+        void end_update();
+        /**
+         * Returns true if the calling thread is in an update that may
+         * change shared objects in place
+         */
+        bool in_place() const;
+
+    private:
+        /* Reader epoch (0 = not in a critical section) on its own line */
+        struct reader_slot {
+            atomic<unsigned long> epoch;
+            atomic<bool> in_use;
+            char padding[64 - sizeof(atomic<unsigned long>) -
+                sizeof(atomic<bool>)];
+        };
+        /* Reader slots, a new block is linked when all slots are used */
+        struct slot_block {
+            reader_slot slots[slots_per_block];
+            atomic<int> num_used;  /**< Slots used so far */
+            atomic<slot_block*> next;  /**< Next block (NULL = last) */
+            slot_block();
+        };
+        struct retired_object {
+            void* ptr;
+            void (*deleter)(void*);
+            unsigned long epoch;  /**< Global epoch when retired */
+        };
+
+        EpochManager(const EpochManager&);
+        EpochManager& operator=(const EpochManager&);
+
+        atomic<unsigned long> global_epoch_;  /**< Current epoch */
+        slot_block slots_;  /**< First block of reader slots */
+        atomic<int> num_readers_;  /**< Threads that hold a slot */
+        atomic<int> num_in_place_;  /**< Updates that change objects in
+                                      place */
+        atomic<long> num_retired_;  /**< Size of retired_ (read without
+                                      the lock) */
+        mutex retired_mutex_;  /**< Protects retired_ (writers only) */
+        vector<retired_object> retired_;  /**< Objects waiting to be freed */
+
+        template<typename T>
+        static void delete_object(void* ptr) {
+            delete static_cast<T*>(ptr);
+        };
+        /**
+         * Slot of the calling thread (registered on first use and released
+         * when the thread exits)
+         */
+        reader_slot* acquire_slot();
+        void release_slot(reader_slot* slot);
+        friend struct epoch_registration;
+};
+
+/* Epoch manager of all Mondrian trees */
+extern EpochManager epoch_manager;
+
+/**
+ * Read-side critical section (scope of the object)
+ */
+class EpochGuard {
+    public:
+        EpochGuard() {epoch_manager.enter();};
+        ~EpochGuard() {epoch_manager.exit();};
+    private:
+        EpochGuard(const EpochGuard&);
+        EpochGuard& operator=(const EpochGuard&);
+};
+
+#endif /* STREAM_BASED_AL_EPOCH_H_ */
@@ -14,6 +14,75 @@
 #include "stream_based_al_forest.h"
 
 
+/*---------------------------------------------------------------------------*/
+/*
+* Uncertainty measures (see "confidence_measure" in the config file)
+*/
+/* First best vs. second best */
+static float uncertainty_margin(const arma::fvec& pred_prob,
+    const mondrian_confidence& m_conf) {
+float first_class = max(pred_prob);
+float second_class = 0.0;
+for (int i = 0; i < int(pred_prob.size()); i++) {
+    if (pred_prob[i] > second_class && pred_prob[i] < first_class) {
+        second_class = pred_prob[i];
+    }
+}
+return 1 - first_class + second_class;
+}
+
+/* Normalized entropy */
+static float uncertainty_entropy(const arma::fvec& pred_prob,
+    const mondrian_confidence& m_conf) {
+assert(pred_prob.size() > 1);
+float uncertainty = 0.0;
+float log_num_classes = log(pred_prob.size());
+for (int i = 0; i < int(pred_prob.size()); i++){
+    if(pred_prob(i) > 0)
+        uncertainty += -pred_prob(i)*log(pred_prob(i))/log_num_classes;
+}
+return uncertainty;
+}
+
+/* Normalized density */
+static float uncertainty_density(const arma::fvec& pred_prob,
+    const mondrian_confidence& m_conf) {
+return m_conf.normalized_density;
+}
+
+/* Random */
+static float uncertainty_random(const arma::fvec& pred_prob,
+    const mondrian_confidence& m_conf) {
+return rng.rand_uniform_distribution(0, 1);
+}
+
+/* Unknown measure: no uncertainty */
+static float uncertainty_none(const arma::fvec& pred_prob,
+    const mondrian_confidence& m_conf) {
+return 0.0;
+}
+
+uncertainty_measure select_uncertainty_measure(int confidence_measure) {
+switch (confidence_measure) {
+    case 0: return &uncertainty_margin;
+    case 1: return &uncertainty_entropy;
+    case 2: return &uncertainty_density;
+    case 3: return &uncertainty_random;
+    default: return &uncertainty_none;
+}
+}
+
+/*
+* Share of the memory budget the governor collapses down to (so that the
+* trees are not scanned again after every sample)
+*/
+static const float memory_budget_low_water = 0.9;
+
+/*
+* Samples per batch of sharded training (see train())
+*/
+static const unsigned int shard_batch_size = 256;
+
 /*---------------------------------------------------------------------------*/
 /*
 * Construct Mondrian forest
@@ -21,11 +90,23 @@
 MondrianForest::MondrianForest(const mondrian_settings& settings,
             const int& feature_dim) :
 data_counter_(0),
-settings_(&settings) {
-MondrianTree* tree = NULL;
-for (int n_tree = 0; n_tree < settings.num_trees; n_tree++) {
-    tree = new MondrianTree(settings, feature_dim);
-    trees_.push_back(tree);
+num_samples_(0),
+feature_dim_(feature_dim),
+num_shards_(max(1, min(settings.num_shards, settings.num_trees))),
+settings_(&settings),
+uncertainty_measure_(select_uncertainty_measure(
+        settings.confidence_measure)) {
+trees_.reserve(settings.num_trees);
+try {
+    for (int n_tree = 0; n_tree < settings.num_trees; n_tree++) {
+        trees_.push_back(new MondrianTree(settings, feature_dim));
+    }
+} catch (...) {
+    /* The destructor does not run for a partly constructed forest */
+    for (unsigned int n_tree = 0; n_tree < trees_.size(); n_tree++) {
+        delete trees_[n_tree];
+    }
+    throw;
 }
 }
 
@@ -44,23 +125,342 @@ float MondrianForest::get_data_counter() const{
 * Update current data point
 */
 void MondrianForest::update(Sample& sample) {
+unsigned long long start_time = monotonic_time_ns();
+uint64_t position = num_samples_++;
 data_counter_++;
 
-/* Update all trees with current sample */
+if (num_shards_ > 1)
+    register_class(sample);
+/* Update the trees of the shard of the sample (all trees if not sharded) */
+update_shard(shard_of(sample, position), sample);
+if (settings_->memory_budget > 0)
+    enforce_memory_budget();
+update_latency_.record(monotonic_time_ns() - start_time);
+if (settings_->validate_interval > 0 &&
+        num_samples_ % settings_->validate_interval == 0)
+    validate();
+}
+
+/*
+* Update with a batch of samples (the shards in parallel)
+*/
+void MondrianForest::update_batch(vector<Sample>& samples, ThreadPool* pool) {
+if (samples.empty())
+    return;
+unsigned long long start_time = monotonic_time_ns();
+uint64_t first_position = num_samples_;
+if (num_shards_ > 1 && pool != NULL) {
+    /* Classes are registered before the shards run concurrently */
+    vector<vector<unsigned int> > shard_samples(num_shards_);
+    for (unsigned int i = 0; i < samples.size(); i++) {
+        register_class(samples[i]);
+        shard_samples[shard_of(samples[i], first_position + i)].push_back(i);
+    }
+    /* The shards have disjoint trees, every tree still has one writer */
+    for (int shard = 0; shard < num_shards_; shard++) {
+        if (shard_samples[shard].empty())
+            continue;
+        vector<unsigned int>& indices = shard_samples[shard];
+        /* Workers draw from seeds of this thread (reproducible with a
+           fixed seed) */
+        unsigned int seed = (unsigned int)(rng.rand_uniform_distribution() *
+                                           4294967295.0);
+        pool->submit([this, shard, seed, &samples, &indices]() {
+            rng.set_seed(seed);
+            for (unsigned int i = 0; i < indices.size(); i++)
+                update_shard(shard, samples[indices[i]]);
+        });
+    }
+    pool->wait();
+} else {
+    for (unsigned int i = 0; i < samples.size(); i++) {
+        if (num_shards_ > 1)
+            register_class(samples[i]);
+        update_shard(shard_of(samples[i], first_position + i), samples[i]);
+    }
+}
+data_counter_ += samples.size();
+num_samples_ += samples.size();
+if (settings_->memory_budget > 0)
+    enforce_memory_budget();
+/* Latency per sample (amortized over the batch) */
+unsigned long long sample_time = (monotonic_time_ns() - start_time) /
+    samples.size();
+for (unsigned int i = 0; i < samples.size(); i++)
+    update_latency_.record(sample_time);
+if (settings_->validate_interval > 0 &&
+        num_samples_ / settings_->validate_interval !=
+        first_position / settings_->validate_interval)
+    validate();
+}
+
+/*
+* Shard of a sample: round robin over the stream positions or FNV-1a hash
+* of the feature values (equal samples always go to the same shard)
+*/
+int MondrianForest::shard_of(const Sample& sample, uint64_t position) const {
+if (num_shards_ == 1)
+    return 0;
+if (settings_->shard_mode != 1)
+    return int(position % num_shards_);
+uint32_t hash = 2166136261u;
+for (int d = 0; d < int(sample.x.size()); d++) {
+    unsigned char bytes[sizeof(float)];
+    float value = sample.x[d];
+    memcpy(bytes, &value, sizeof(float));
+    for (unsigned int k = 0; k < sizeof(float); k++) {
+        hash ^= bytes[k];
+        hash *= 16777619u;
+    }
+}
+return int(hash % uint32_t(num_shards_));
+}
+
+void MondrianForest::register_class(const Sample& sample) {
 for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    /* Histograms of the nodes grow when they see the new class, cached
+       posteriors of trees of the other shards are recomputed now */
+    trees_[n_tree]->add_classes(sample.y + 1);
+}
+}
+
+void MondrianForest::update_shard(int shard, Sample& sample) {
+for (int n_tree = shard; n_tree < settings_->num_trees;
+        n_tree += num_shards_) {
     trees_[n_tree]->update(sample);
 }
 }
 
 /*
-* Predict class of current class
+* Check invariants of all trees
 */
-int MondrianForest::classify(Sample& sample) {
-/* Go through all trees and calculate probability */
-//float expo_param = 1.0;
-mondrian_confidence m_conf = {0,0,0};
-arma::fvec pred_prob = predict_probability(sample, m_conf);
+void MondrianForest::validate() {
+int num_violations = 0;
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    num_violations += trees_[n_tree]->validate_tree();
+}
+if (num_violations > 0) {
+    cout << "[ERROR] - MondrianForest::validate: " << num_violations <<
+        " violated invariants after " << data_counter_ << " samples" << endl;
+    exit(EXIT_FAILURE);
+}
+}
+
+/*
+* Memory governor: collapse internal nodes whose children are both leaves,
+* least expected probability mass first, until the forest is below the
+* low-water mark of the budget
+*/
+long MondrianForest::enforce_memory_budget() {
+long total_bytes = tree_bytes();
+if (total_bytes <= settings_->memory_budget)
+    return 0;
+long target_bytes = long(memory_budget_low_water *
+        settings_->memory_budget);
+long num_collapsed = 0;
+vector<mondrian_twig> twigs;
+while (total_bytes > target_bytes) {
+    /*
+     * Collapsing a twig does not change the other twigs, its parent may
+     * become a twig of the next round
+     */
+    twigs.clear();
+    for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+        trees_[n_tree]->collect_twigs(twigs);
+    }
+    if (twigs.empty())
+        break;
+    sort(twigs.begin(), twigs.end());
+    for (unsigned int i = 0; i < twigs.size() && total_bytes > target_bytes;
+            i++) {
+        total_bytes -= twigs[i].tree->collapse(*twigs[i].node);
+        num_collapsed++;
+    }
+}
+/* Free the collapsed nodes no reader can reach */
+epoch_manager.collect();
+return num_collapsed;
+}
+
+/*
+* Snapshot of a forest: magic, version, settings, feature dimension,
+* number of samples, the trees and optionally the label dictionary
+* (native byte order)
+*/
+static const char snapshot_magic[8] = {'S', 'B', 'A', 'L', 'M', 'F', 0, 0};
+static const uint32_t snapshot_version = 4;
+/* Version 1 snapshots have no shard settings (every tree learns every
+   sample), trees of version 1 and 2 snapshots have no sample counter,
+   and forests before version 4 have no stream position */
+static const uint32_t snapshot_min_version = 1;
+/* Limits of a plausible snapshot header (a corrupt header must not
+   allocate billions of trees) */
+static const int32_t snapshot_max_trees = 1 << 16;
+static const int32_t snapshot_max_feature_dim = 1 << 24;
+
+void MondrianForest::save(ostream& os, const LabelDictionary* labels) const {
+os.write(snapshot_magic, sizeof(snapshot_magic));
+write_binary(os, snapshot_version);
+write_binary(os, int32_t(settings_->num_trees));
+write_binary(os, settings_->init_budget);
+write_binary(os, settings_->discount_factor);
+write_binary(os, settings_->discount_param);
+write_binary(os, settings_->decision_prior_hyperparam);
+write_binary(os, uint8_t(settings_->debug));
+write_binary(os, int32_t(settings_->max_samples_in_one_node));
+write_binary(os, int32_t(settings_->confidence_measure));
+write_binary(os, settings_->density_exponent);
+write_binary(os, int32_t(settings_->validate_interval));
+write_binary(os, int64_t(settings_->memory_budget));
+write_binary(os, int32_t(settings_->forget_half_life));
+write_binary(os, int32_t(settings_->num_shards));
+write_binary(os, int32_t(settings_->shard_mode));
+write_binary(os, int32_t(feature_dim_));
+write_binary(os, data_counter_);
+write_binary(os, num_samples_);
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    trees_[n_tree]->save(os);
+}
+/* External labels in the order of their internal indices */
+if (labels != NULL) {
+    write_binary(os, int32_t(labels->size()));
+    for (int k = 0; k < labels->size(); k++) {
+        write_binary(os, int32_t(labels->to_external(k)));
+    }
+}
+}
+
+/*
+* Store the reason of a failed save or load (if the caller asked for it)
+*/
+static void set_error(string* error, const string& message) {
+if (error != NULL)
+    *error = message;
+}
 
+bool MondrianForest::save(const string& filename,
+    const LabelDictionary* labels, string* error) const {
+string tmp_filename = filename + ".tmp";
+ofstream file(tmp_filename.c_str(), ios::binary | ios::trunc);
+if (!file.is_open()) {
+    set_error(error, "cannot open " + tmp_filename);
+    return false;
+}
+save(file, labels);
+file.close();
+if (file.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    set_error(error, "cannot write " + filename);
+    remove(tmp_filename.c_str());
+    return false;
+}
+return true;
+}
+
+MondrianForest* MondrianForest::load(istream& is,
+    mondrian_settings& settings, LabelDictionary* labels, string* error) {
+char magic[sizeof(snapshot_magic)];
+uint32_t version = 0;
+is.read(magic, sizeof(magic));
+if (!is || memcmp(magic, snapshot_magic, sizeof(magic)) != 0 ||
+        !read_binary(is, version) || version < snapshot_min_version ||
+        version > snapshot_version) {
+    ostringstream message;
+    message << "not a forest snapshot (version " << snapshot_min_version <<
+        " to " << snapshot_version << ")";
+    set_error(error, message.str());
+    return NULL;
+}
+int32_t num_trees = 0, max_samples_in_one_node = 0, confidence_measure = 0;
+int32_t validate_interval = 0, forget_half_life = 0, feature_dim = 0;
+int32_t num_shards = 1, shard_mode = 0;
+int64_t memory_budget = 0;
+uint8_t debug = 0;
+float data_counter = 0;
+uint64_t num_samples = 0;
+bool valid = read_binary(is, num_trees) &&
+    read_binary(is, settings.init_budget) &&
+    read_binary(is, settings.discount_factor) &&
+    read_binary(is, settings.discount_param) &&
+    read_binary(is, settings.decision_prior_hyperparam) &&
+    read_binary(is, debug) && read_binary(is, max_samples_in_one_node) &&
+    read_binary(is, confidence_measure) &&
+    read_binary(is, settings.density_exponent) &&
+    read_binary(is, validate_interval) && read_binary(is, memory_budget) &&
+    read_binary(is, forget_half_life) &&
+    (version < 2 || (read_binary(is, num_shards) &&
+                     read_binary(is, shard_mode))) &&
+    read_binary(is, feature_dim) &&
+    read_binary(is, data_counter) &&
+    (version < 4 || read_binary(is, num_samples)) &&
+    num_trees > 0 && num_trees <= snapshot_max_trees &&
+    feature_dim > 0 && feature_dim <= snapshot_max_feature_dim &&
+    num_shards > 0 && num_shards <= snapshot_max_trees &&
+    confidence_measure >= 0 && confidence_measure <= 3;
+if (!valid) {
+    set_error(error, "invalid header");
+    return NULL;
+}
+settings.num_trees = num_trees;
+settings.debug = (debug != 0);
+settings.max_samples_in_one_node = max_samples_in_one_node;
+settings.confidence_measure = confidence_measure;
+settings.validate_interval = validate_interval;
+settings.memory_budget = long(memory_budget);
+settings.forget_half_life = forget_half_life;
+settings.num_shards = num_shards;
+settings.shard_mode = shard_mode;
+
+MondrianForest* forest = new MondrianForest(settings, feature_dim);
+forest->data_counter_ = data_counter;
+forest->num_samples_ = version < 4 ? uint64_t(data_counter) : num_samples;
+for (int n_tree = 0; n_tree < num_trees; n_tree++) {
+    bool loaded = false;
+    try {
+        loaded = forest->trees_[n_tree]->load(is, version);
+    } catch (...) {
+        delete forest;
+        throw;
+    }
+    if (!loaded) {
+        ostringstream message;
+        message << "tree " << n_tree << " is invalid";
+        set_error(error, message.str());
+        delete forest;
+        return NULL;
+    }
+}
+/* Snapshots without label dictionary end after the trees */
+int32_t num_labels = 0;
+if (labels != NULL && read_binary(is, num_labels)) {
+    LabelDictionary snapshot_labels;
+    for (int k = 0; k < num_labels; k++) {
+        int32_t label = 0;
+        if (!read_binary(is, label) ||
+                snapshot_labels.to_internal(label) != k) {
+            set_error(error, "invalid label dictionary");
+            delete forest;
+            return NULL;
+        }
+    }
+    *labels = snapshot_labels;
+}
+return forest;
+}
+
+MondrianForest* MondrianForest::load(const string& filename,
+    mondrian_settings& settings, LabelDictionary* labels, string* error) {
+ifstream file(filename.c_str(), ios::binary);
+if (!file.is_open()) {
+    set_error(error, "cannot open " + filename);
+    return NULL;
+}
+return load(file, settings, labels, error);
+}
+
+/*
+* Class with the highest probability (-2 if all probabilities are the same)
+*/
+static int predicted_class(arma::fvec& pred_prob) {
 int pred_class = -1;  /* Predicted class of Mondrian forest */
 /* If all probabilies are the same -> return -2 */
 if (equal_elements(pred_prob)) {
@@ -74,14 +474,78 @@ for (int i = 0; i < int(pred_prob.size()); i++) {
         pred_class = i;
     }
 }
-
 return pred_class;
 }
+
+/*
+* Predict class of current class
+*/
+int MondrianForest::classify(Sample& sample) {
+/* Go through all trees and calculate probability */
+//float expo_param = 1.0;
+mondrian_confidence m_conf = {0,0,0};
+arma::fvec pred_prob = predict_probability(sample, m_conf);
+
+return predicted_class(pred_prob);
+}
+
+/*
+* Classify a batch of samples tree by tree
+*/
+void MondrianForest::classify_batch(vector<Sample>& samples,
+    vector<int>& classes, vector<pair<int, float> >& predictions) {
+unsigned long long start_time = monotonic_time_ns();
+/* One read-side critical section for the whole batch */
+EpochGuard guard;
+int num_classes = trees_[0]->num_classes_;
+vector<arma::fvec> pred_prob(samples.size(),
+    arma::fvec(num_classes, arma::fill::zeros));
+vector<mondrian_confidence> m_conf(samples.size(), mondrian_confidence());
+vector<float> normalized_density(samples.size(), 0.);
+arma::fvec tmp_pred_prob(num_classes);
+int num_voting_trees = 0;
+/* The upper nodes of a tree stay in the cache for the whole batch */
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    if (trees_[n_tree]->get_data_counter() == 0)
+        continue;
+    num_voting_trees++;
+    for (unsigned int i = 0; i < samples.size(); i++) {
+        tmp_pred_prob.zeros();
+        trees_[n_tree]->classify(samples[i], tmp_pred_prob, m_conf[i]);
+        normalized_density[i] += m_conf[i].normalized_density;
+        pred_prob[i] += tmp_pred_prob;
+    }
+}
+classes.resize(samples.size());
+predictions.resize(samples.size());
+if (num_voting_trees == 0) {
+    /* A forest without samples has no classes yet */
+    fill(classes.begin(), classes.end(), -1);
+    fill(predictions.begin(), predictions.end(), make_pair(-1, 0.0f));
+    return;
+}
+for (unsigned int i = 0; i < samples.size(); i++) {
+    pred_prob[i] = pred_prob[i] / num_voting_trees;
+    m_conf[i].normalized_density = normalized_density[i] / num_voting_trees;
+    classes[i] = predicted_class(pred_prob[i]);
+    predictions[i] = confident_prediction(pred_prob[i], m_conf[i]);
+}
+if (!samples.empty()) {
+    /* Latency per sample (amortized over the batch) */
+    unsigned long long sample_time = (monotonic_time_ns() - start_time) /
+        samples.size();
+    for (unsigned int i = 0; i < samples.size(); i++)
+        classify_latency_.record(sample_time);
+}
+}
 /**
 * Predict class and return confidence
 */
 pair<int, float> MondrianForest::classify_confident(Sample& sample) {
-pair<int, float> prediction (0, 0.0);
+/* A forest without samples has no classes yet */
+if (!has_learned())
+    return make_pair(-1, 0.0f);
+unsigned long long start_time = monotonic_time_ns();
 
 /* Distance value that influence prediction */
 /* Init confidence values */
@@ -90,6 +554,17 @@ mondrian_confidence m_conf;
 /* Go through all trees and calculate probability */
 arma::fvec pred_prob = predict_probability(sample, m_conf);
 
+pair<int, float> prediction = confident_prediction(pred_prob, m_conf);
+classify_latency_.record(monotonic_time_ns() - start_time);
+return prediction;
+}
+
+/*
+* Predicted class and confidence of the forest probabilities
+*/
+pair<int, float> MondrianForest::confident_prediction(arma::fvec& pred_prob,
+    mondrian_confidence& m_conf) {
+pair<int, float> prediction (0, 0.0);
 int pred_class = -1;  /* Predicted class of Mondrian forest */
 float tmp_value = 0.;
 for (int i = 0; i < int(pred_prob.size()); i++) {
@@ -112,58 +587,150 @@ for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
 }
 }
 
+/*
+* Print hot-path counters of all trees as JSON document
+*/
+void MondrianForest::print_counters(const string& phase) {
+if (!instrumentation_enabled())
+    return;
+vector<mondrian_counters> tree_counters;
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    tree_counters.push_back(trees_[n_tree]->counters_);
+    trees_[n_tree]->counters_.reset();
+}
+cout << endl;
+cout << "Instrumentation counters:" << endl;
+write_counters_json(cout, phase, tree_counters);
+}
+
+/*
+* Return size and memory statistics summed over all trees
+*/
+mondrian_tree_stats MondrianForest::get_stats() const {
+mondrian_tree_stats stats;
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    stats += trees_[n_tree]->get_stats();
+}
+return stats;
+}
+
+/*
+* Memory of all trees
+*/
+long MondrianForest::tree_bytes() const {
+long total_bytes = 0;
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    total_bytes += trees_[n_tree]->stats_.total_bytes();
+}
+return total_bytes;
+}
+
+/*
+* Memory of the trees and the latency histograms
+*/
+long MondrianForest::memory_bytes() const {
+return tree_bytes() + update_latency_.memory_bytes() +
+    classify_latency_.memory_bytes() + active_step_latency_.memory_bytes();
+}
+
+/*
+* Print size and memory statistics of the forest
+*/
+void MondrianForest::print_stats() {
+cout << endl;
+cout << "Forest statistics (" << data_counter_ << " samples, " <<
+    settings_->num_trees << " trees):" << endl;
+if (settings_->memory_budget > 0)
+    cout << "memory budget [kB]: " << settings_->memory_budget / 1024. <<
+        endl;
+get_stats().print(cout);
+}
+
+/*
+* Print latency percentiles
+*/
+void MondrianForest::print_latency(const string& phase, bool reset) {
+cout << endl;
+cout << "Latency (" << phase << "):" << endl;
+if (update_latency_.count() > 0)
+    update_latency_.print(cout, "update");
+if (classify_latency_.count() > 0)
+    classify_latency_.print(cout, "classify_confident");
+if (active_step_latency_.count() > 0)
+    active_step_latency_.print(cout, "active_step");
+if (reset) {
+    update_latency_.reset();
+    classify_latency_.reset();
+    active_step_latency_.reset();
+}
+}
+
+/*
+* Returns true if at least one tree has learned a sample
+*/
+bool MondrianForest::has_learned() const {
+for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
+    if (trees_[n_tree]->get_data_counter() > 0)
+        return true;
+}
+return false;
+}
+
 /*
 * Calculates probability of current sample
 * (returns probability of all classes)
 */
 arma::fvec MondrianForest::predict_probability(Sample& sample,
     mondrian_confidence& m_conf) {
+/* One read-side critical section for all trees */
+EpochGuard guard;
+/* Read once: a concurrent update may add a class (the trees clamp) */
+int num_classes = trees_[0]->num_classes_;
 /* Go through all trees and calculate probability */
-arma::fvec pred_prob(trees_[0]->num_classes_, arma::fill::zeros);
+arma::fvec pred_prob(num_classes, arma::fill::zeros);
 float tmp_normalized_density_forest = 0;
+int num_voting_trees = 0;
 for (int n_tree = 0; n_tree < settings_->num_trees; n_tree++) {
-    arma::fvec tmp_pred_prob(trees_[0]->num_classes_, arma::fill::zeros);
+    /* Trees of a shard without samples yet do not vote */
+    if (trees_[n_tree]->get_data_counter() == 0)
+        continue;
+    arma::fvec tmp_pred_prob(num_classes, arma::fill::zeros);
     trees_[n_tree]->classify(sample, tmp_pred_prob, m_conf);
     tmp_normalized_density_forest += m_conf.normalized_density;
     pred_prob += tmp_pred_prob;
+    num_voting_trees++;
 }
-pred_prob = pred_prob / settings_->num_trees;
-m_conf.normalized_density = tmp_normalized_density_forest/settings_->num_trees;
+num_voting_trees = max(1, num_voting_trees);
+pred_prob = pred_prob / num_voting_trees;
+m_conf.normalized_density = tmp_normalized_density_forest / num_voting_trees;
 
 return pred_prob;
 }
 
+/*
+* Classifies all samples of a window with one tree (the same per tree
+* computation as predict_probability)
+*/
+void MondrianForest::score_window(int n_tree, vector<Sample>& window,
+    vector<arma::fvec>& pred_prob, vector<mondrian_confidence>& m_conf) {
+pred_prob.resize(window.size());
+m_conf.resize(window.size());
+for (unsigned int i = 0; i < window.size(); i++) {
+    pred_prob[i].zeros(trees_[n_tree]->num_classes_);
+    m_conf[i] = mondrian_confidence();
+    if (trees_[n_tree]->get_data_counter() > 0)
+        trees_[n_tree]->classify(window[i], pred_prob[i], m_conf[i]);
+}
+}
+
 
 /*
 * Calculates confidence value
 */
 float MondrianForest::confidence_prediction(arma::fvec& pred_prob,
     mondrian_confidence& m_conf) {
-float uncertainty = 0.0;
-
-if(settings_->confidence_measure == 0){
-/* Confidence: first best vs. second best */
-    float first_class = max(pred_prob);
-    float second_class = 0.0;
-    for (int i = 0; i < int(pred_prob.size()); i++) {
-        if (pred_prob[i] > second_class && pred_prob[i] < first_class) {
-            second_class = pred_prob[i];
-        }
-    }
-    uncertainty = 1 - first_class + second_class;
-}
-else if(settings_->confidence_measure == 1){
-/* Confidence: normalized entropy */
-    assert(pred_prob.size() > 1);
-    for (int i = 0; i < pred_prob.size(); i++){
-        if(pred_prob(i) > 0)
-            uncertainty += -pred_prob(i)*log(pred_prob(i))/log(pred_prob.size());
-    }
-}else if(settings_->confidence_measure == 2){
-    uncertainty = m_conf.normalized_density;
-}else if(settings_->confidence_measure == 3){
-    uncertainty = rng.rand_uniform_distribution(0, 1);
-}
+/* Measure is selected once at construction (no switch per sample) */
+float uncertainty = uncertainty_measure_(pred_prob, m_conf);
 
 float beta = settings_->density_exponent;
 float confidence = 1 - uncertainty * pow((m_conf.normalized_density),beta);
@@ -202,18 +769,56 @@ boost::progress_display show_progress( expected_count );
 /* Initialize stop time for training */
 timeval startTime;
 gettimeofday(&startTime, NULL);
+/* Hardware counters (optional) */
+PerfCounters perf_counters(hp.perf_counters_);
+perf_counters.start();
+TraceSpan train_span("train", "train");
+
+/*
+ * Sharded forest: the shards learn batches of samples in parallel (one
+ * worker per shard)
+ */
+ThreadPool* shard_pool = NULL;
+if (num_shards_ > 1)
+    shard_pool = new ThreadPool(num_shards_);
+vector<Sample> shard_batch;
 
 /*---------------------------------------------------------------------*/
 /* Go through complete training set */
 int long i_samp = 0;
 for (; i_samp < number_training_samples; i_samp++) {
+    bool traced = tracer.trace_sample(i_samp);
     Sample sample = dataset.get_next_sample();
-    update(sample);
+    bool report_latency = hp.latency_report_interval_ > 0 &&
+        (i_samp + 1) % hp.latency_report_interval_ == 0;
+    bool report_stats = hp.print_stats_ &&
+        (i_samp + 1) % hp.stats_interval_ == 0;
+    if (shard_pool != NULL) {
+        shard_batch.push_back(sample);
+        /* Reports see all samples up to the current one */
+        if (shard_batch.size() == shard_batch_size || report_latency ||
+            report_stats || i_samp + 1 == number_training_samples) {
+            TraceSpan span("update_batch", "train", traced, i_samp);
+            update_batch(shard_batch, shard_pool);
+            shard_batch.clear();
+        }
+    } else {
+        TraceSpan span("update", "train", traced, i_samp);
+        update(sample);
+    }
+    /* Print intermediate latencies */
+    if (report_latency)
+        print_latency("train", false);
+    /* Print intermediate statistics */
+    if (report_stats)
+        print_stats();
     /* Show progress */
     ++show_progress;
 }
+delete shard_pool;
 
 /*---------------------------------------------------------------------*/
+perf_counters.stop();
 cout << endl;
 cout << " ... finished training after: ";
 timeval endTime;
@@ -221,6 +826,12 @@ gettimeofday(&endTime, NULL);
 float tmp_training_time = (endTime.tv_sec - startTime.tv_sec +
                            (endTime.tv_usec - startTime.tv_usec) / 1e6);
 cout << tmp_training_time << " seconds." << endl;
+if (hp.perf_counters_)
+    perf_counters.print(cout, "train", i_samp);
+print_counters("train");
+print_latency("train");
+if (hp.print_stats_)
+    print_stats();
 }
 
 
@@ -259,6 +870,14 @@ gettimeofday(&startTime, NULL);
 
 /* Variables of active learning */
 vector<float> active_conf_values;
+unsigned long num_processed_samples = 0;
+/* Hardware counters (optional) */
+PerfCounters perf_counters(hp.perf_counters_);
+perf_counters.start();
+/* Trace spans of the whole training and of the initial training set */
+TraceSpan train_span("train_active", "train_active");
+double init_set_start = tracer.now();
+bool init_set_phase = true;
 
 /*---------------------------------------------------------------------*/
 /* Go through complete training set */
@@ -272,71 +891,116 @@ vector<float> active_conf_values;
  */
 if (hp.active_learning_ == 1) {
     for (int long i_samp = 0; i_samp < number_training_samples ; i_samp++) {
+        bool traced = tracer.trace_sample(i_samp);
         Sample sample = dataset.get_next_sample();
         
         if (data_counter_ < hp.active_init_set_size_) {
             /* Initial training set without active learning */
             update(sample);
         } else {
+            if (init_set_phase) {
+                tracer.complete("active_init", "train_active", init_set_start,
+                                tracer.now() - init_set_start);
+                init_set_phase = false;
+            }
+            /* Remaining samples are scored in a pipeline */
+            if (hp.active_pipeline_threads_ > 0) {
+                num_processed_samples += train_active_pipelined(dataset, hp,
+                    sample, i_samp, number_training_samples, show_progress);
+                break;
+            }
             /* Stop training if the number of samples used for training is larger than specified */
             if (data_counter_ == hp.active_max_num_queries_){
                 break;
             }
-            pair<int, float> pred = classify_confident(sample);
+            unsigned long long step_start_time = monotonic_time_ns();
+            pair<int, float> pred;
+            {
+                TraceSpan span("score", "train_active", traced, i_samp);
+                pred = classify_confident(sample);
+            }
             if (pred.second < hp.active_confidence_value_) {
+                TraceSpan span("update", "train_active", traced, i_samp);
                 update(sample);
             }
+            active_step_latency_.record(monotonic_time_ns() - step_start_time);
         }
+        /* Print intermediate latencies */
+        if (hp.latency_report_interval_ > 0 &&
+            (i_samp + 1) % hp.latency_report_interval_ == 0)
+            print_latency("train_active", false);
+        /* Print intermediate statistics */
+        if (hp.print_stats_ && (i_samp + 1) % hp.stats_interval_ == 0)
+            print_stats();
         /* Show progress */
         ++show_progress;
+        ++num_processed_samples;
     }
 } else if (hp.active_learning_ == 2) {
     
     /* Active learning with buffering samples to learn only samples that are very
      * uncertain (last x%)*/
     
-    pair<Sample, float> i_active_sample;
-    list<pair<Sample, float> > active_buffer;
+    /* Only the "active_buffer_size" + 1 least confident samples are used */
+    UncertaintyBuffer active_buffer(hp.active_buffer_size_ + 1);
     int count_buffer = 0;
     
     for (int long i_samp = 0; i_samp < number_training_samples; i_samp++) {
+        bool traced = tracer.trace_sample(i_samp);
         Sample sample = dataset.get_next_sample();
         
         if (data_counter_ < hp.active_init_set_size_) {
             update(sample);
         } else {
+            if (init_set_phase) {
+                tracer.complete("active_init", "train_active", init_set_start,
+                                tracer.now() - init_set_start);
+                init_set_phase = false;
+            }
             /* Stop training if the number of samples used for training is larger than specified */
             if (data_counter_ == hp.active_max_num_queries_){
                 break;
             }
             
-            pair<int, float> pred = classify_confident(sample);
-            i_active_sample.first = sample;
-            i_active_sample.second = pred.second;
+            unsigned long long step_start_time = monotonic_time_ns();
+            pair<int, float> pred;
+            {
+                TraceSpan span("score", "train_active", traced, i_samp);
+                pred = classify_confident(sample);
+            }
             /* Insert sample */
-            insert_sort(active_buffer, i_active_sample);
+            active_buffer.insert(sample, pred.second);
             count_buffer++;
             
             if (count_buffer >= hp.active_batch_size_) {
+                TraceSpan span("buffer_flush", "train_active", true, i_samp);
                 /* Go through active buffer and update "active_buffer" of most uncertain
                  * samples */
-                list<pair<Sample, float> >::iterator it = active_buffer.begin();
-                for (int i_buf = 0; it != active_buffer.end(); it++) {
-                    update((*it).first);
+                active_buffer.sort();
+                for (int i_buf = 0; i_buf < active_buffer.size(); i_buf++) {
+                    update(active_buffer.sample(i_buf));
                     if (i_buf == 0)
-                        active_conf_values.push_back((*it).second);
-                    if (i_buf == hp.active_buffer_size_){
-                        active_conf_values.push_back((*it).second);
-                        break;
-                    }
-                    ++i_buf;
+                        active_conf_values.push_back(
+                            active_buffer.confidence(i_buf));
+                    if (i_buf == hp.active_buffer_size_)
+                        active_conf_values.push_back(
+                            active_buffer.confidence(i_buf));
                 }
                 count_buffer = 0;
                 active_buffer.clear();
             }
+            active_step_latency_.record(monotonic_time_ns() - step_start_time);
         }
+        /* Print intermediate latencies */
+        if (hp.latency_report_interval_ > 0 &&
+            (i_samp + 1) % hp.latency_report_interval_ == 0)
+            print_latency("train_active", false);
+        /* Print intermediate statistics */
+        if (hp.print_stats_ && (i_samp + 1) % hp.stats_interval_ == 0)
+            print_stats();
         /* Show progress */
         ++show_progress;
+        ++num_processed_samples;
     }
     
     
@@ -346,6 +1010,10 @@ if (hp.active_learning_ == 1) {
 }
 
 /*---------------------------------------------------------------------*/
+perf_counters.stop();
+if (init_set_phase)
+    tracer.complete("active_init", "train_active", init_set_start,
+                    tracer.now() - init_set_start);
 cout << endl;
 cout << " ... finished training after: ";
 timeval endTime;
@@ -353,7 +1021,159 @@ gettimeofday(&endTime, NULL);
 float tmp_training_time = (endTime.tv_sec - startTime.tv_sec +
                            (endTime.tv_usec - startTime.tv_usec) / 1e6);
 cout << tmp_training_time << " seconds." << endl;
+if (hp.perf_counters_)
+    perf_counters.print(cout, "train_active", num_processed_samples);
+print_counters("train_active");
+print_latency("train_active");
+if (hp.print_stats_)
+    print_stats();
+}
+/*
+* Active learning 1 with pipelined scoring
+*
+* The stream is processed in windows of "active_pipeline_staleness" + 1
+* samples. The main thread is the only writer: it applies the queried
+* samples of a window tree by tree. As soon as a tree is updated, a worker
+* scores the next window with this tree, while the main thread updates the
+* next tree. The scores of the trees are combined in tree order as in
+* predict_probability(). A score therefore misses at most the updates of
+* the earlier samples of its window, and a window of one sample gives the
+* same results as the sequential loop.
+*/
+unsigned long MondrianForest::train_active_pipelined(DataSet& dataset,
+    Hyperparameters& hp, Sample& first_sample, long i_first,
+    long number_training_samples, boost::progress_display& show_progress) {
+ThreadPool pool(hp.active_pipeline_threads_);
+const int num_trees = settings_->num_trees;
+const long window_size = long(hp.active_pipeline_staleness_) + 1;
+/* Scores of the current window per tree and sample */
+vector<vector<arma::fvec> > tree_prob(num_trees);
+vector<vector<mondrian_confidence> > tree_conf(num_trees);
+vector<Sample> window;
+vector<Sample> next_window;
+vector<int> queries;  /* Window positions of the queried samples */
+long i_next = i_first + 1;  /* Index of the next sample of the stream */
+long i_window = i_first;  /* Index of the first sample of the window */
+unsigned long num_processed_samples = 0;
+bool stop = false;
+
+/* Score the first window */
+window.push_back(first_sample);
+while (long(window.size()) < window_size && i_next < number_training_samples) {
+    window.push_back(dataset.get_next_sample());
+    i_next++;
+}
+for (int n_tree = 0; n_tree < num_trees; n_tree++) {
+    pool.submit([this, n_tree, &window, &tree_prob, &tree_conf]() {
+        score_window(n_tree, window, tree_prob[n_tree], tree_conf[n_tree]);
+    });
 }
+pool.wait();
+
+while (!window.empty()) {
+    unsigned long long step_start_time = monotonic_time_ns();
+    TraceSpan span("pipeline_window", "train_active",
+                   tracer.trace_sample(i_window), i_window);
+    /* Query decisions in stream order */
+    queries.clear();
+    long num_decided = 0;
+    for (unsigned int i = 0; i < window.size(); i++) {
+        /* Stop training if the number of samples used for training is larger than specified */
+        if (data_counter_ + queries.size() == hp.active_max_num_queries_) {
+            stop = true;
+            break;
+        }
+        arma::fvec pred_prob(tree_prob[0][i].n_elem, arma::fill::zeros);
+        float tmp_normalized_density_forest = 0;
+        mondrian_confidence m_conf = mondrian_confidence();
+        int num_voting_trees = 0;
+        for (int n_tree = 0; n_tree < num_trees; n_tree++) {
+            /* Unchanged since the window was scored */
+            if (trees_[n_tree]->get_data_counter() == 0)
+                continue;
+            pred_prob += tree_prob[n_tree][i];
+            tmp_normalized_density_forest +=
+                tree_conf[n_tree][i].normalized_density;
+            m_conf = tree_conf[n_tree][i];
+            num_voting_trees++;
+        }
+        num_voting_trees = max(1, num_voting_trees);
+        pred_prob = pred_prob / num_voting_trees;
+        m_conf.normalized_density = tmp_normalized_density_forest /
+            num_voting_trees;
+        pair<int, float> pred = confident_prediction(pred_prob, m_conf);
+        if (pred.second < hp.active_confidence_value_)
+            queries.push_back(i);
+        num_decided++;
+    }
+    /* Read next window */
+    next_window.clear();
+    while (!stop && long(next_window.size()) < window_size &&
+           i_next < number_training_samples) {
+        next_window.push_back(dataset.get_next_sample());
+        i_next++;
+    }
+    /* Update tree by tree and score the next window with updated trees */
+    unsigned long long update_start_time = monotonic_time_ns();
+    /* Shard of every query (the trees of other shards skip it) */
+    vector<int> query_shards(queries.size());
+    for (unsigned int q = 0; q < queries.size(); q++) {
+        if (num_shards_ > 1)
+            register_class(window[queries[q]]);
+        query_shards[q] = shard_of(window[queries[q]], num_samples_ + q);
+    }
+    for (int n_tree = 0; n_tree < num_trees; n_tree++) {
+        for (unsigned int q = 0; q < queries.size(); q++) {
+            if (query_shards[q] == n_tree % num_shards_)
+                trees_[n_tree]->update(window[queries[q]]);
+        }
+        if (!next_window.empty()) {
+            pool.submit([this, n_tree, &next_window, &tree_prob, &tree_conf]() {
+                score_window(n_tree, next_window, tree_prob[n_tree],
+                             tree_conf[n_tree]);
+            });
+        }
+    }
+    unsigned long long update_time = monotonic_time_ns() - update_start_time;
+    uint64_t validated = settings_->validate_interval > 0 ?
+        num_samples_ / settings_->validate_interval : 0;
+    data_counter_ += queries.size();
+    num_samples_ += queries.size();
+    pool.wait();
+    /* After the scores, so they do not depend on the timing of the workers */
+    if (settings_->memory_budget > 0)
+        enforce_memory_budget();
+    /* Latencies are averaged over the samples of the window */
+    for (unsigned int q = 0; q < queries.size(); q++)
+        update_latency_.record(update_time / queries.size());
+    unsigned long long step_time = monotonic_time_ns() - step_start_time;
+    for (long i = 0; i < num_decided; i++)
+        active_step_latency_.record(step_time / num_decided);
+    if (settings_->validate_interval > 0 &&
+        num_samples_ / settings_->validate_interval != validated)
+        validate();
+
+    for (long i = 0; i < num_decided; i++) {
+        long i_samp = i_window + i;
+        /* Print intermediate latencies */
+        if (hp.latency_report_interval_ > 0 &&
+            (i_samp + 1) % hp.latency_report_interval_ == 0)
+            print_latency("train_active", false);
+        /* Print intermediate statistics */
+        if (hp.print_stats_ && (i_samp + 1) % hp.stats_interval_ == 0)
+            print_stats();
+        /* Show progress */
+        ++show_progress;
+        ++num_processed_samples;
+    }
+    if (stop)
+        break;
+    i_window += window.size();
+    window.swap(next_window);
+}
+return num_processed_samples;
+}
+
 /**
 * Classify the given data set and store i
 */
@@ -385,12 +1205,18 @@ boost::progress_display show_progress( expected_count );
 
 int pred_class = 0;  /* Predicted class */
 int conf_pos = 0;  /* Position of confidence value */
+/* Hardware counters (optional) */
+PerfCounters perf_counters(hp.perf_counters_);
+perf_counters.start();
+TraceSpan classify_span("classify", "classify");
 
 /* Go through complete test set */
 for (unsigned int n_elem = 0; n_elem < dataset.num_samples_; n_elem++) {
+    bool traced = tracer.trace_sample(n_elem);
     
     /* Get next sample */
     Sample sample = dataset.get_next_sample();
+    TraceSpan span("classify_sample", "classify", traced, n_elem);
     
     pred_class = 0;
     
@@ -423,6 +1249,7 @@ for (unsigned int n_elem = 0; n_elem < dataset.num_samples_; n_elem++) {
 }
 
 /*---------------------------------------------------------------------*/
+perf_counters.stop();
 
 cout << endl;
 cout << " ... finished testing after: ";
@@ -432,6 +1259,10 @@ float tmp_testing_time = (endTime.tv_sec - startTime.tv_sec +
                           (endTime.tv_usec - startTime.tv_usec) / 1e6);
 pResult.testing_time_ += tmp_testing_time;
 cout << tmp_testing_time << " seconds." << endl;
+if (hp.perf_counters_)
+    perf_counters.print(cout, "classify", dataset.num_samples_);
+print_counters("classify");
+print_latency("classify");
 
 /* Evaluate test results */
 Metrics::compute_metrics(dataset, pResult);
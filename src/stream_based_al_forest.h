@@ -14,11 +14,11 @@
 #ifndef STREAM_BASED_AL_FOREST_H_
 #define STREAM_BASED_AL_FOREST_H_
 
-/* Evaluate assertion */
-//#define NDEBUG /* Comment out if no assertion is needed */
+/* Evaluate assertion (compiled out by "make release", -DNDEBUG) */
 #include <assert.h> 
 
 #include <list>
+#include <sstream>
 #include <algorithm>  /* Used for count elements in vector */
 #include <armadillo>  /* Matrix, vector library */
 #include "stream_based_al_random.h"
@@ -26,6 +26,10 @@
 #include "stream_based_al_tree.hpp"
 #include "stream_based_al_hyperparameters.h"
 #include "stream_based_al_metrics.hpp"
+#include "stream_based_al_latency.h"
+#include "stream_based_al_perf_counters.h"
+#include "stream_based_al_trace.h"
+#include "stream_based_al_thread_pool.h"
 #include <limits>
 
 /* Boost */
@@ -34,8 +38,22 @@
 
 
 /*---------------------------------------------------------------------------*/
-// Forward declaration of external random number generator
-extern RandomGenerator rng;
+// Forward declaration of external random number generator (one per thread,
+// so forests can be updated on different threads)
+extern thread_local RandomGenerator rng;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Uncertainty of a prediction (used to compute the confidence)
+ */
+typedef float (*uncertainty_measure)(const arma::fvec& pred_prob,
+        const mondrian_confidence& m_conf);
+
+/**
+ * Returns the uncertainty measure of "confidence_measure"
+ * (0 = margin, 1 = entropy, 2 = density, 3 = random)
+ */
+uncertainty_measure select_uncertainty_measure(int confidence_measure);
 
 /*---------------------------------------------------------------------------*/
 /**
@@ -54,6 +72,15 @@ class MondrianForest {
          * Update current data point
          */ 
         void update(Sample& sample);
+        /**
+         * Update with a batch of samples in order (same trees and order per
+         * tree as update() of the single samples). With more than one
+         * shard and a thread pool, the shards learn their samples in
+         * parallel; the memory budget is enforced after the batch.
+         *
+         * @param pool      : Workers for the shards (NULL = this thread)
+         */
+        void update_batch(vector<Sample>& samples, ThreadPool* pool = NULL);
     
         /**
          * Function trains a Mondrian forest
@@ -83,9 +110,21 @@ class MondrianForest {
         int classify(Sample& sample);
     
         /**
-         * Predict class and return confidence
+         * Predict class and return confidence (class -1 and confidence 0
+         * while the forest has not learned any sample)
          */
         pair<int, float> classify_confident(Sample& sample);
+        /**
+         * Classify a batch of samples tree by tree, so the upper nodes of a
+         * tree are loaded once per batch (same results as classify and
+         * classify_confident of the single samples, class -1 while the
+         * forest has not learned any sample)
+         *
+         * @param classes       : Result of classify() per sample
+         * @param predictions   : Result of classify_confident() per sample
+         */
+        void classify_batch(vector<Sample>& samples, vector<int>& classes,
+                vector<pair<int, float> >& predictions);
         /**
          * Function tests/evaluates a mondrian forest
          *
@@ -100,19 +139,165 @@ class MondrianForest {
         void classify(DataSet& dataset, Result& pResult, Hyperparameters& hp);
     
         float get_data_counter() const;
+        /**
+         * Number of samples learned (position in the stream)
+         */
+        inline uint64_t get_num_samples() const {return num_samples_;};
 
         void print_info();
+        /**
+         * Print hot-path counters of all trees as JSON document
+         * (only available if compiled with instrumentation)
+         *
+         * @param phase : Name of the phase that is reported
+         */
+        void print_counters(const string& phase);
+        /**
+         * Print latency percentiles of update, classify_confident and the
+         * active learning step
+         *
+         * @param phase : Name of the phase that is reported
+         * @param reset : Clear histograms after printing
+         */
+        void print_latency(const string& phase, bool reset = true);
+        /**
+         * Return size and memory statistics summed over all trees
+         */
+        mondrian_tree_stats get_stats() const;
+        /**
+         * Memory of the forest in bytes: the trees (maintained by the trees,
+         * no walk) and the latency histograms
+         */
+        long memory_bytes() const;
+        /**
+         * Print size and memory statistics of the forest
+         */
+        void print_stats();
+        /**
+         * Check invariants of all trees, stop if one is violated
+         */
+        void validate();
+        /**
+         * Collapse the least valuable subtrees of all trees while the
+         * forest uses more memory than the budget of the settings
+         *
+         * @return          : Number of collapsed nodes
+         */
+        long enforce_memory_budget();
+        /**
+         * Write the forest (settings, trees and samples seen) to a snapshot
+         * (not concurrently with update())
+         *
+         * @param labels    : Label dictionary stored with the forest
+         *                    (optional)
+         */
+        void save(ostream& os, const LabelDictionary* labels = NULL) const;
+        /**
+         * Write a snapshot to "filename" (through a temporary file, so the
+         * file is always complete)
+         *
+         * @param error     : Set to the reason of a failure (optional)
+         * @return          : False if the file could not be written
+         */
+        bool save(const string& filename,
+                const LabelDictionary* labels = NULL,
+                string* error = NULL) const;
+        /**
+         * Create a forest from a snapshot written by save()
+         *
+         * @param settings  : Filled with the settings of the snapshot (used
+         *                    by the forest, must outlive it)
+         * @param labels    : Filled with the label dictionary of the
+         *                    snapshot (unchanged if none was stored)
+         * @param error     : Set to the reason of a failure (optional)
+         * @return          : New forest or NULL if the snapshot is invalid
+         */
+        static MondrianForest* load(istream& is, mondrian_settings& settings,
+                LabelDictionary* labels = NULL, string* error = NULL);
+        static MondrianForest* load(const string& filename,
+                mondrian_settings& settings, LabelDictionary* labels = NULL,
+                string* error = NULL);
+        /**
+         * Dimension of the feature vectors
+         */
+        inline int get_feature_dim() const {return feature_dim_;};
+        /**
+         * Number of classes (internal labels 0..n-1) seen by the forest
+         */
+        inline int get_num_classes() const {return trees_[0]->num_classes_;};
+        /**
+         * Number of shards of the trees (1 = every tree learns every
+         * sample)
+         */
+        inline int get_num_shards() const {return num_shards_;};
         
     private:
         float data_counter_;  /**< Count incoming data points */
+        uint64_t num_samples_;  /**< Position in the stream (samples
+                                  learned; exact, unlike the float
+                                  data_counter_ beyond 2^24) */
+        int feature_dim_;  /**< Dimension of feature vectors */
+        int num_shards_;  /**< Shards of the trees (tree n belongs to shard
+                            n % num_shards_) */
         vector<MondrianTree*> trees_;  /**< Save all Mondrian trees */
         const mondrian_settings* settings_;  /**< Settings of a Mondrian forest */
+        uncertainty_measure uncertainty_measure_;  /**< Selected by
+                                                     confidence_measure */
+        LatencyHistogram update_latency_;  /**< Latency of update() */
+        LatencyHistogram classify_latency_;  /**< Latency of
+                                               classify_confident() */
+        LatencyHistogram active_step_latency_;  /**< Latency of scoring and
+                                                  (maybe) learning a sample
+                                                  in train_active() */
+        /*
+         * Memory of all trees in bytes (the part the memory budget bounds)
+         */
+        long tree_bytes() const;
+        /*
+         * Returns true if at least one tree has learned a sample (a forest
+         * without samples has no classes yet)
+         */
+        bool has_learned() const;
         /*
          * Calculates probability of current sample
          * (returns probability of all classes)
          */
         arma::fvec predict_probability(Sample& sample,
                 mondrian_confidence& m_conf);
+        /*
+         * Predicted class and confidence of the forest probabilities
+         */
+        pair<int, float> confident_prediction(arma::fvec& pred_prob,
+                mondrian_confidence& m_conf);
+        /*
+         * Classifies all samples of "window" with tree "n_tree"
+         * (probabilities and confidence values per sample)
+         */
+        void score_window(int n_tree, vector<Sample>& window,
+                vector<arma::fvec>& pred_prob,
+                vector<mondrian_confidence>& m_conf);
+        /*
+         * Active learning 1 with pipelined scoring, starting with sample
+         * "first_sample" (index "i_first") after the initial training set
+         * (returns number of processed samples)
+         */
+        unsigned long train_active_pipelined(DataSet& dataset,
+                Hyperparameters& hp, Sample& first_sample, long i_first,
+                long number_training_samples,
+                boost::progress_display& show_progress);
+        /*
+         * Shard of sample "sample" at stream position "position"
+         */
+        int shard_of(const Sample& sample, uint64_t position) const;
+        /*
+         * Register the class of "sample" in all trees, so the trees of
+         * every shard predict the same classes
+         */
+        void register_class(const Sample& sample);
+        /*
+         * Update the trees of shard "shard" with "sample"
+         */
+        void update_shard(int shard, Sample& sample);
         /*
          * Calculates confidence value
          */
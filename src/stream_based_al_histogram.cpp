@@ -0,0 +1,180 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_histogram.h"
+
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Label histogram
+ */
+LabelHistogram::LabelHistogram() :
+    num_inline_entries_(0),
+    total_(0),
+    dense_(NULL) {
+}
+
+LabelHistogram::LabelHistogram(const LabelHistogram& other) :
+    num_inline_entries_(0),
+    total_(0),
+    dense_(NULL) {
+    *this = other;
+}
+
+LabelHistogram& LabelHistogram::operator=(const LabelHistogram& other) {
+    if (this == &other)
+        return *this;
+    for (int i = 0; i < other.num_inline_entries_; i++) {
+        inline_labels_[i] = other.inline_labels_[i];
+        inline_counts_[i] = other.inline_counts_[i];
+    }
+    num_inline_entries_ = other.num_inline_entries_;
+    total_ = other.total_;
+    if (other.dense_ == NULL) {
+        delete dense_;
+        dense_ = NULL;
+    } else {
+        if (dense_ == NULL)
+            dense_ = new dense_storage;
+        *dense_ = *other.dense_;
+    }
+    return *this;
+}
+
+LabelHistogram::~LabelHistogram() {
+    delete dense_;
+    dense_ = NULL;
+}
+
+void LabelHistogram::increment(int label, uint32_t n) {
+    total_ += n;
+    if (dense_ == NULL) {
+        for (int i = 0; i < num_inline_entries_; i++) {
+            if (inline_labels_[i] == label) {
+                inline_counts_[i] += n;
+                return;
+            }
+        }
+        if (num_inline_entries_ < num_inline_) {
+            inline_labels_[num_inline_entries_] = label;
+            inline_counts_[num_inline_entries_] = n;
+            num_inline_entries_++;
+            return;
+        }
+        spill();
+    }
+    if (int(dense_->counts.size()) <= label)
+        dense_->counts.resize(label + 1, 0);
+    if (dense_->counts[label] == 0)
+        dense_->labels.push_back(label);
+    dense_->counts[label] += n;
+}
+
+uint32_t LabelHistogram::count(int label) const {
+    if (dense_ == NULL) {
+        for (int i = 0; i < num_inline_entries_; i++) {
+            if (inline_labels_[i] == label)
+                return inline_counts_[i];
+        }
+        return 0;
+    }
+    if (label < 0 || label >= int(dense_->counts.size()))
+        return 0;
+    return dense_->counts[label];
+}
+
+void LabelHistogram::halve(int num_halvings) {
+    if (num_halvings <= 0)
+        return;
+    /* Shifting a 32 bit count by 32 or more bits is undefined */
+    int shift = num_halvings < 32 ? num_halvings : 32;
+    /* Readers see the old or the new total, never a partial sum */
+    uint32_t total = 0;
+    if (dense_ == NULL) {
+        int num_kept = 0;
+        for (int i = 0; i < num_inline_entries_; i++) {
+            uint32_t cnt = shift < 32 ? inline_counts_[i] >> shift : 0;
+            if (cnt > 0) {
+                inline_labels_[num_kept] = inline_labels_[i];
+                inline_counts_[num_kept] = cnt;
+                total += cnt;
+                num_kept++;
+            }
+        }
+        num_inline_entries_ = num_kept;
+        total_ = total;
+        return;
+    }
+    vector<int> labels;
+    for (unsigned int i = 0; i < dense_->labels.size(); i++) {
+        int cur_label = dense_->labels[i];
+        uint32_t& cnt = dense_->counts[cur_label];
+        cnt = shift < 32 ? cnt >> shift : 0;
+        if (cnt > 0) {
+            labels.push_back(cur_label);
+            total += cnt;
+        }
+    }
+    total_ = total;
+    if (int(labels.size()) > num_inline_) {
+        dense_->labels.swap(labels);
+        return;
+    }
+    /* Few labels left: back to inline storage */
+    for (unsigned int i = 0; i < labels.size(); i++) {
+        inline_labels_[i] = labels[i];
+        inline_counts_[i] = dense_->counts[labels[i]];
+    }
+    num_inline_entries_ = int(labels.size());
+    delete dense_;
+    dense_ = NULL;
+}
+
+void LabelHistogram::clear() {
+    num_inline_entries_ = 0;
+    total_ = 0;
+    delete dense_;
+    dense_ = NULL;
+}
+
+long LabelHistogram::memory_bytes() const {
+    long bytes = sizeof(LabelHistogram);
+    if (dense_ != NULL) {
+        bytes += sizeof(dense_storage) +
+            dense_->counts.capacity() * sizeof(uint32_t) +
+            dense_->labels.capacity() * sizeof(int);
+    }
+    return bytes;
+}
+
+/*
+ * Move inline entries to dense storage
+ */
+void LabelHistogram::spill() {
+    dense_ = new dense_storage;
+    for (int i = 0; i < num_inline_entries_; i++) {
+        int cur_label = inline_labels_[i];
+        if (int(dense_->counts.size()) <= cur_label)
+            dense_->counts.resize(cur_label + 1, 0);
+        dense_->counts[cur_label] = inline_counts_[i];
+        dense_->labels.push_back(cur_label);
+    }
+    num_inline_entries_ = 0;
+}
+
+ostream& operator<<(ostream& os, const LabelHistogram& hist) {
+    for (int i = 0; i < hist.num_entries(); i++) {
+        os << hist.label(i) << ":" << hist.count_at(i) << " ";
+    }
+    return os << "(total " << hist.total() << ")";
+}
@@ -0,0 +1,125 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_HISTOGRAM_H_
+#define STREAM_BASED_AL_HISTOGRAM_H_
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+#include "stream_based_al_epoch.h"
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Label histogram of a Mondrian node
+ *
+ * Most nodes only see one or two classes. Up to "num_inline_" different
+ * labels are stored as (label, count) pairs inside the object; if more
+ * labels arrive, the counts spill to a dense array indexed by label.
+ * Counts are 32 bit. Only labels with a count > 0 are stored, so the
+ * entries 0..num_entries()-1 are exactly the nonzero entries.
+ *
+ * The tree has a single writer, but predictions read the total
+ * concurrently: the total and the inline entries are relaxed atomics. The
+ * dense storage is only read by the writer.
+ */
+class LabelHistogram {
+    public:
+        static const int num_inline_ = 4;  /**< Labels stored inline */
+
+        LabelHistogram();
+        LabelHistogram(const LabelHistogram& other);
+        LabelHistogram& operator=(const LabelHistogram& other);
+        ~LabelHistogram();
+        /**
+         * Increase count of "label" by "n"
+         */
+        void increment(int label, uint32_t n = 1);
+        /**
+         * Return count of "label" (0 if the label was not seen)
+         */
+        uint32_t count(int label) const;
+        /**
+         * Divide all counts by 2^"num_halvings" (rounded down), labels
+         * whose count drops to zero are removed
+         */
+        void halve(int num_halvings);
+        /**
+         * Remove all counts
+         */
+        void clear();
+        /**
+         * Number of labels with a count > 0
+         */
+        inline int num_entries() const {
+            return dense_ == NULL ? num_inline_entries_.load() :
+                int(dense_->labels.size());
+        };
+        /**
+         * Label of the i-th nonzero entry
+         */
+        inline int label(int i) const {
+            return dense_ == NULL ? inline_labels_[i].load() : dense_->labels[i];
+        };
+        /**
+         * Count of the i-th nonzero entry
+         */
+        inline uint32_t count_at(int i) const {
+            return dense_ == NULL ? inline_counts_[i].load() :
+                dense_->counts[dense_->labels[i]];
+        };
+        /**
+         * Sum of all counts
+         */
+        inline unsigned long total() const {return total_;};
+        /**
+         * Returns true if the counts spilled to dense storage
+         */
+        inline bool is_dense() const {return dense_ != NULL;};
+        /**
+         * Memory of the histogram (object and dense storage) in bytes
+         */
+        long memory_bytes() const;
+
+    private:
+        /**
+         * Dense storage (used if more than "num_inline_" labels are seen)
+         */
+        struct dense_storage {
+            vector<uint32_t> counts;  /**< Count of each label */
+            vector<int> labels;  /**< Labels with a count > 0 */
+        };
+
+        relaxed<int> inline_labels_[num_inline_];  /**< Labels of inline
+                                                     entries */
+        relaxed<uint32_t> inline_counts_[num_inline_];  /**< Counts of inline
+                                                          entries */
+        relaxed<int> num_inline_entries_;  /**< Number of used inline
+                                             entries */
+        relaxed<uint32_t> total_;  /**< Sum of all counts */
+        dense_storage* dense_;  /**< Dense storage (NULL while inline) */
+
+        /**
+         * Move inline entries to dense storage
+         */
+        void spill();
+};
+
+/**
+ * Print histogram as "label:count" pairs
+ */
+ostream& operator<<(ostream& os, const LabelHistogram& hist);
+
+#endif /* STREAM_BASED_AL_HISTOGRAM_H_ */
@@ -0,0 +1,210 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_host.h"
+
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Forest host
+ */
+ForestHost::ForestHost(int num_threads, int quantum) :
+    quantum_(quantum > 0 ? quantum : 1),
+    pool_(num_threads) {
+}
+
+ForestHost::~ForestHost() {
+    wait();
+    map<string, hosted_forest*>::iterator it;
+    for (it = forests_.begin(); it != forests_.end(); it++) {
+        delete it->second->forest;
+        delete it->second;
+    }
+    forests_.clear();
+}
+
+bool ForestHost::add_forest(const string& name,
+        const mondrian_settings& settings, int feature_dim) {
+    unique_lock<mutex> lock(mutex_);
+    if (forests_.find(name) != forests_.end())
+        return false;
+    hosted_forest* entry = new hosted_forest;
+    entry->name = name;
+    entry->settings = settings;
+    /* The forest keeps a pointer to the settings of the entry */
+    entry->forest = new MondrianForest(entry->settings, feature_dim);
+    entry->scheduled = false;
+    entry->removed = false;
+    entry->num_updates = 0;
+    entry->num_classifications = 0;
+    entry->memory_bytes = entry->forest->memory_bytes();
+    forests_[name] = entry;
+    return true;
+}
+
+bool ForestHost::remove_forest(const string& name) {
+    unique_lock<mutex> lock(mutex_);
+    map<string, hosted_forest*>::iterator it = forests_.find(name);
+    if (it == forests_.end())
+        return false;
+    hosted_forest* entry = it->second;
+    forests_.erase(it);
+    if (entry->scheduled) {
+        /* Deleted by the worker after the last queued request */
+        entry->removed = true;
+        return true;
+    }
+    lock.unlock();
+    delete entry->forest;
+    delete entry;
+    return true;
+}
+
+bool ForestHost::submit_update(const string& name, const Sample& sample) {
+    request req;
+    req.update = true;
+    req.sample = sample;
+    return submit(name, req);
+}
+
+bool ForestHost::submit_classify(const string& name, const Sample& sample,
+        const classify_callback& done) {
+    request req;
+    req.update = false;
+    req.sample = sample;
+    req.done = done;
+    return submit(name, req);
+}
+
+bool ForestHost::submit(const string& name, const request& req) {
+    unique_lock<mutex> lock(mutex_);
+    map<string, hosted_forest*>::iterator it = forests_.find(name);
+    if (it == forests_.end())
+        return false;
+    hosted_forest* entry = it->second;
+    entry->requests.push_back(req);
+    if (entry->scheduled)
+        return true;
+    /* One pool task per turn in the ready queue */
+    entry->scheduled = true;
+    ready_.push_back(entry);
+    lock.unlock();
+    pool_.submit(bind(&ForestHost::run_turn, this));
+    return true;
+}
+
+void ForestHost::run_turn() {
+    hosted_forest* entry = NULL;
+    vector<request> batch;
+    {
+        unique_lock<mutex> lock(mutex_);
+        entry = ready_.front();
+        ready_.pop_front();
+        int num_requests = min(quantum_, int(entry->requests.size()));
+        batch.assign(entry->requests.begin(),
+                     entry->requests.begin() + num_requests);
+        entry->requests.erase(entry->requests.begin(),
+                              entry->requests.begin() + num_requests);
+    }
+    /* Only this worker uses the forest until the turn ends */
+    long num_updates = 0;
+    for (unsigned int i = 0; i < batch.size(); i++) {
+        if (batch[i].update) {
+            entry->forest->update(batch[i].sample);
+            num_updates++;
+        } else {
+            pair<int, float> result =
+                entry->forest->classify_confident(batch[i].sample);
+            if (batch[i].done)
+                batch[i].done(result);
+        }
+    }
+    /* Other threads only see the memory of the finished turn */
+    long memory_bytes = entry->forest->memory_bytes();
+    {
+        unique_lock<mutex> lock(mutex_);
+        entry->memory_bytes = memory_bytes;
+        entry->num_updates += num_updates;
+        entry->num_classifications += long(batch.size()) - num_updates;
+        if (!entry->requests.empty()) {
+            /* Next turn after all other ready forests */
+            ready_.push_back(entry);
+            lock.unlock();
+            pool_.submit(bind(&ForestHost::run_turn, this));
+            return;
+        }
+        entry->scheduled = false;
+        if (!entry->removed)
+            return;
+    }
+    delete entry->forest;
+    delete entry;
+}
+
+void ForestHost::wait() {
+    pool_.wait();
+}
+
+int ForestHost::num_forests() {
+    unique_lock<mutex> lock(mutex_);
+    return int(forests_.size());
+}
+
+vector<hosted_forest_stats> ForestHost::get_stats() {
+    unique_lock<mutex> lock(mutex_);
+    vector<hosted_forest_stats> stats;
+    map<string, hosted_forest*>::iterator it;
+    for (it = forests_.begin(); it != forests_.end(); it++) {
+        hosted_forest_stats forest_stats;
+        forest_stats.name = it->first;
+        forest_stats.memory_bytes = it->second->memory_bytes;
+        forest_stats.num_updates = it->second->num_updates;
+        forest_stats.num_classifications = it->second->num_classifications;
+        forest_stats.num_pending = long(it->second->requests.size());
+        stats.push_back(forest_stats);
+    }
+    return stats;
+}
+
+long ForestHost::memory_bytes() {
+    vector<hosted_forest_stats> stats = get_stats();
+    long total_bytes = 0;
+    for (unsigned int i = 0; i < stats.size(); i++)
+        total_bytes += stats[i].memory_bytes;
+    return total_bytes;
+}
+
+void ForestHost::print_stats(ostream& os) {
+    vector<hosted_forest_stats> stats = get_stats();
+    long total_bytes = 0, min_bytes = 0, max_bytes = 0, num_pending = 0;
+    string max_name;
+    for (unsigned int i = 0; i < stats.size(); i++) {
+        total_bytes += stats[i].memory_bytes;
+        num_pending += stats[i].num_pending;
+        if (i == 0 || stats[i].memory_bytes < min_bytes)
+            min_bytes = stats[i].memory_bytes;
+        if (i == 0 || stats[i].memory_bytes > max_bytes) {
+            max_bytes = stats[i].memory_bytes;
+            max_name = stats[i].name;
+        }
+    }
+    os << "forests: " << stats.size() << "  workers: " << pool_.size() <<
+        "  pending requests: " << num_pending << endl;
+    os << "memory [kB]: total: " << total_bytes / 1024. << "  per forest: "
+        "min: " << min_bytes / 1024. << "  mean: " <<
+        (stats.empty() ? 0. : total_bytes / 1024. / stats.size()) <<
+        "  max: " << max_bytes / 1024.;
+    if (!max_name.empty())
+        os << " (" << max_name << ")";
+    os << endl;
+}
@@ -0,0 +1,161 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_HOST_H_
+#define STREAM_BASED_AL_HOST_H_
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <iostream>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include "stream_based_al_forest.h"
+#include "stream_based_al_thread_pool.h"
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Memory and work of a forest of the host
+ */
+struct hosted_forest_stats {
+    string name;  /**< Name of the forest */
+    long memory_bytes;  /**< Memory of the forest after its last turn */
+    long num_updates;  /**< Learned samples */
+    long num_classifications;  /**< Classified samples */
+    long num_pending;  /**< Queued requests */
+};
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Many independent Mondrian forests in one process
+ *
+ * Every forest has a queue of update and classify requests, which are
+ * processed in order of submission by the workers of one shared thread
+ * pool. A forest is processed by at most one worker at a time (single
+ * writer). Forests with pending requests take turns: a worker processes at
+ * most "quantum" requests of a forest and then moves it to the end of the
+ * ready queue, so a busy forest cannot starve the others.
+ *
+ * The trees draw their random numbers from the generator of the worker
+ * thread, so results are not reproducible with more than one worker.
+ */
+class ForestHost {
+    public:
+        /**
+         * Result of a classify request (class and confidence)
+         */
+        typedef function<void(const pair<int, float>&)> classify_callback;
+
+        /**
+         * Start "num_threads" workers that process at most "quantum"
+         * requests of a forest per turn
+         */
+        ForestHost(int num_threads, int quantum = 16);
+        /**
+         * Finish all requests and delete the forests
+         */
+        ~ForestHost();
+        /**
+         * Create forest "name" (returns false if the name is in use)
+         */
+        bool add_forest(const string& name, const mondrian_settings& settings,
+                int feature_dim);
+        /**
+         * Delete forest "name" after its queued requests are processed
+         * (returns false if there is no such forest)
+         */
+        bool remove_forest(const string& name);
+        /**
+         * Queue a training sample of forest "name"
+         */
+        bool submit_update(const string& name, const Sample& sample);
+        /**
+         * Queue a sample of forest "name" to classify; "done" is called on
+         * a worker thread with the class and confidence (-1 if the forest
+         * has not learned any sample yet)
+         */
+        bool submit_classify(const string& name, const Sample& sample,
+                const classify_callback& done);
+        /**
+         * Block until all queued requests are processed
+         */
+        void wait();
+        /**
+         * Number of forests
+         */
+        int num_forests();
+        /**
+         * Memory and work of every forest (exact after wait(); the memory
+         * of a forest is taken by its worker at the end of each turn)
+         */
+        vector<hosted_forest_stats> get_stats();
+        /**
+         * Sum of the memory of all forests in bytes
+         */
+        long memory_bytes();
+        /**
+         * Print number of forests, total memory and the memory per forest
+         */
+        void print_stats(ostream& os);
+
+    private:
+        /**
+         * Queued request of a forest
+         */
+        struct request {
+            bool update;  /**< Learn (true) or classify (false) "sample" */
+            Sample sample;  /**< Sample of the request */
+            classify_callback done;  /**< Result of a classify request */
+        };
+        /**
+         * Forest, its settings and its queue
+         */
+        struct hosted_forest {
+            string name;  /**< Name of the forest */
+            mondrian_settings settings;  /**< Settings (used by the trees) */
+            MondrianForest* forest;  /**< Forest */
+            deque<request> requests;  /**< Queued requests */
+            bool scheduled;  /**< In the ready queue or being processed */
+            bool removed;  /**< Delete when the queue is empty */
+            long num_updates;  /**< Learned samples */
+            long num_classifications;  /**< Classified samples */
+            long memory_bytes;  /**< Memory of the forest at the end of
+                                  its last turn */
+        };
+
+        /* Forests and workers belong to this host (no copies) */
+        ForestHost(const ForestHost&);
+        ForestHost& operator=(const ForestHost&);
+
+        int quantum_;  /**< Requests of a forest per turn */
+        mutex mutex_;  /**< Protects forests_, ready_ and the queues */
+        map<string, hosted_forest*> forests_;  /**< Forests by name */
+        deque<hosted_forest*> ready_;  /**< Forests with queued requests
+                                         in the order of their turns */
+        ThreadPool pool_;  /**< Shared workers */
+
+        /**
+         * Queue a request and schedule the forest if it was idle
+         */
+        bool submit(const string& name, const request& req);
+        /**
+         * Process the next turn of the ready queue (task of the pool)
+         */
+        void run_turn();
+};
+
+#endif /* STREAM_BASED_AL_HOST_H_ */
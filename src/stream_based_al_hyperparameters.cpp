@@ -49,6 +49,24 @@ Hyperparameters::Hyperparameters(const string& conf_file) {
         "Mondrian.max_samples_in_one_node");
     confidence_measure_ = (int) config_file.lookup("Mondrian.confidence_measure");
     density_exponent_ = (float) config_file.lookup("Mondrian.density_exponent");
+    /* Keys that older config files do not have are optional (defaults of
+       conf/stream_based_al.conf) */
+    validate_interval_ = 0;
+    config_file.lookupValue("Mondrian.validate_interval", validate_interval_);
+    memory_budget_ = 0;
+    config_file.lookupValue("Mondrian.memory_budget", memory_budget_);
+    if (memory_budget_ < 0)
+        memory_budget_ = 0;
+    forget_half_life_ = 0;
+    config_file.lookupValue("Mondrian.forget_half_life", forget_half_life_);
+    if (forget_half_life_ < 0)
+        forget_half_life_ = 0;
+    num_shards_ = 1;
+    config_file.lookupValue("Mondrian.num_shards", num_shards_);
+    if (num_shards_ < 1)
+        num_shards_ = 1;
+    shard_mode_ = 0;
+    config_file.lookupValue("Mondrian.shard_mode", shard_mode_);
     print_properties_ = (bool)config_file.lookup("Mondrian.print_properties");
 
     /* Parameters for training */
@@ -67,4 +85,40 @@ Hyperparameters::Hyperparameters(const string& conf_file) {
         "Training.active_buffer_size");
     active_confidence_value_ = config_file.lookup(
         "Training.active_confidence_value");
+    /* Optional keys (see above) */
+    active_pipeline_threads_ = 0;
+    config_file.lookupValue("Training.active_pipeline_threads",
+        active_pipeline_threads_);
+    active_pipeline_staleness_ = 0;
+    config_file.lookupValue("Training.active_pipeline_staleness",
+        active_pipeline_staleness_);
+    if (active_pipeline_staleness_ < 0)
+        active_pipeline_staleness_ = 0;
+    latency_report_interval_ = 0;
+    config_file.lookupValue("Training.latency_report_interval",
+        latency_report_interval_);
+    stats_interval_ = 1000;
+    config_file.lookupValue("Training.stats_interval", stats_interval_);
+    if (stats_interval_ < 1)
+        stats_interval_ = 1;
+    trace_file_ = "";
+    config_file.lookupValue("Training.trace_file", trace_file_);
+    trace_sample_interval_ = 100;
+    config_file.lookupValue("Training.trace_sample_interval",
+        trace_sample_interval_);
+    // Server (optional)
+    server_socket_path_ = "/tmp/stream_based_al.sock";
+    config_file.lookupValue("Server.socket_path", server_socket_path_);
+    server_batch_window_ = 200;
+    config_file.lookupValue("Server.batch_window", server_batch_window_);
+    if (server_batch_window_ < 0)
+        server_batch_window_ = 0;
+    server_max_batch_size_ = 64;
+    config_file.lookupValue("Server.max_batch_size", server_max_batch_size_);
+    if (server_max_batch_size_ < 1)
+        server_max_batch_size_ = 1;
+    server_snapshot_file_ = "forest.snapshot";
+    config_file.lookupValue("Server.snapshot_file", server_snapshot_file_);
+    print_stats_ = false;
+    perf_counters_ = false;
 }
@@ -56,6 +56,15 @@ class Hyperparameters {
                                          is reached */
         int confidence_measure_; /**< Type of confidence measure used in query */
         float density_exponent_;    /** Exponent of the density term in the query measure */
+        int validate_interval_;  /**< Validate trees every n-th sample */
+        int memory_budget_;  /**< Memory ceiling of the forest in kB
+                               (0 = unbounded) */
+        int forget_half_life_;  /**< Halve the counts of the nodes every
+                                  n-th sample (0 = no forgetting) */
+        int num_shards_;  /**< Shards of the trees, every sample updates
+                            the trees of one shard (1 = no sharding) */
+        int shard_mode_;  /**< Samples to shards: 0 = round robin, 1 = hash
+                            of the features */
         bool print_properties_;  /**< Print properties of a Mondrian Forest */
 
         /* Parameters for training */
@@ -83,6 +92,34 @@ class Hyperparameters {
                                          a low confidence and are used to train
                                          the classifier */
         float active_confidence_value_;
+        int active_pipeline_threads_;  /**< Worker threads that score
+                                         upcoming samples in active learning
+                                         1 (0 = sequential loop) */
+        int active_pipeline_staleness_;  /**< Maximum number of updates a
+                                           pipelined score may miss (0 =
+                                           same results as the sequential
+                                           loop) */
+        int latency_report_interval_;  /**< Print latency percentiles every
+                                         "latency_report_interval_" samples
+                                         (0 = only at the end of a run) */
+        int stats_interval_;  /**< Print forest statistics every
+                                "stats_interval_" samples */
+        bool print_stats_;  /**< Print forest statistics during training
+                              (command line option --stats) */
+        bool perf_counters_;  /**< Measure hardware performance counters
+                                (command line option --perf) */
+        string trace_file_;  /**< Chrome trace output file ("" = off) */
+        int trace_sample_interval_;  /**< Trace spans of every n-th sample */
+
+        // Server
+        string server_socket_path_;  /**< Unix domain socket of the server
+                                       (command line option --serve) */
+        int server_batch_window_;  /**< Microseconds classify requests wait
+                                     for more requests of their batch */
+        int server_max_batch_size_;  /**< Maximum classify requests per
+                                       batch */
+        string server_snapshot_file_;  /**< Snapshot file if a snapshot
+                                         request names none */
 
 };
 
@@ -0,0 +1,129 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_instrumentation.h"
+
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Counters of a Mondrian tree
+ */
+mondrian_counters::mondrian_counters() {
+    reset();
+}
+
+void mondrian_counters::reset() {
+    num_updates = 0;
+    num_classifications = 0;
+    num_splits = 0;
+    num_parent_insertions = 0;
+    num_paused_hits = 0;
+    num_update_visits = 0;
+    num_classify_visits = 0;
+    num_new_classes = 0;
+    num_depth_steps = 0;
+    num_update_prob_mass = 0;
+    num_posterior_updates = 0;
+    time_extend = 0.;
+    time_root_update = 0.;
+    time_prob_mass = 0.;
+    time_posterior = 0.;
+    time_classify = 0.;
+}
+
+mondrian_counters& mondrian_counters::operator+=(
+        const mondrian_counters& other) {
+    num_updates += other.num_updates;
+    num_classifications += other.num_classifications;
+    num_splits += other.num_splits;
+    num_parent_insertions += other.num_parent_insertions;
+    num_paused_hits += other.num_paused_hits;
+    num_update_visits += other.num_update_visits;
+    num_classify_visits += other.num_classify_visits;
+    num_new_classes += other.num_new_classes;
+    num_depth_steps += other.num_depth_steps;
+    num_update_prob_mass += other.num_update_prob_mass;
+    num_posterior_updates += other.num_posterior_updates;
+    time_extend += other.time_extend;
+    time_root_update += other.time_root_update;
+    time_prob_mass += other.time_prob_mass;
+    time_posterior += other.time_posterior;
+    time_classify += other.time_classify;
+    return *this;
+}
+
+/*
+ * Write the members of one counter object (without braces)
+ */
+static void write_counters_members(ostream& os, const mondrian_counters& c,
+        const string& indent) {
+    float visits_per_update = (c.num_updates > 0) ?
+        float(c.num_update_visits) / c.num_updates : 0.;
+    float visits_per_classify = (c.num_classifications > 0) ?
+        float(c.num_classify_visits) / c.num_classifications : 0.;
+    os << indent << "\"updates\": " << c.num_updates << "," << endl;
+    os << indent << "\"classifications\": " << c.num_classifications << ","
+        << endl;
+    os << indent << "\"splits\": " << c.num_splits << "," << endl;
+    os << indent << "\"parent_insertions\": " << c.num_parent_insertions
+        << "," << endl;
+    os << indent << "\"paused_hits\": " << c.num_paused_hits << "," << endl;
+    os << indent << "\"update_node_visits\": " << c.num_update_visits << ","
+        << endl;
+    os << indent << "\"update_node_visits_per_sample\": " << visits_per_update
+        << "," << endl;
+    os << indent << "\"classify_node_visits\": " << c.num_classify_visits
+        << "," << endl;
+    os << indent << "\"classify_node_visits_per_sample\": "
+        << visits_per_classify << "," << endl;
+    os << indent << "\"new_classes\": " << c.num_new_classes << ","
+        << endl;
+    os << indent << "\"depth_walk_steps\": " << c.num_depth_steps << ","
+        << endl;
+    os << indent << "\"update_expected_prob_mass_calls\": "
+        << c.num_update_prob_mass << "," << endl;
+    os << indent << "\"posterior_updates\": " << c.num_posterior_updates
+        << "," << endl;
+    os << indent << "\"time_seconds\": {" << endl;
+    os << indent << "  \"extend\": " << c.time_extend << "," << endl;
+    os << indent << "  \"root_update\": " << c.time_root_update << "," << endl;
+    os << indent << "  \"prob_mass\": " << c.time_prob_mass << "," << endl;
+    os << indent << "  \"posterior\": " << c.time_posterior << "," << endl;
+    os << indent << "  \"classify\": " << c.time_classify << endl;
+    os << indent << "}" << endl;
+}
+
+/*
+ * Write counters of all trees and their sum as JSON document
+ */
+void write_counters_json(ostream& os, const string& phase,
+        const vector<mondrian_counters>& trees) {
+    mondrian_counters forest;
+    for (unsigned int n_tree = 0; n_tree < trees.size(); n_tree++) {
+        forest += trees[n_tree];
+    }
+    os << "{" << endl;
+    os << "  \"phase\": \"" << phase << "\"," << endl;
+    os << "  \"num_trees\": " << trees.size() << "," << endl;
+    os << "  \"forest\": {" << endl;
+    write_counters_members(os, forest, "    ");
+    os << "  }," << endl;
+    os << "  \"trees\": [" << endl;
+    for (unsigned int n_tree = 0; n_tree < trees.size(); n_tree++) {
+        os << "    {" << endl;
+        write_counters_members(os, trees[n_tree], "      ");
+        os << "    }" << (n_tree + 1 < trees.size() ? "," : "") << endl;
+    }
+    os << "  ]" << endl;
+    os << "}" << endl;
+}
@@ -0,0 +1,103 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_INSTRUMENTATION_H_
+#define STREAM_BASED_AL_INSTRUMENTATION_H_
+
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Hot-path instrumentation of the Mondrian trees
+ *
+ * The counters are only collected if the code is compiled with
+ * -DSTREAM_BASED_AL_INSTRUMENTATION (make INSTRUMENTATION=1). Otherwise all
+ * macros below expand to nothing and the hot path is left untouched.
+ */
+#ifdef STREAM_BASED_AL_INSTRUMENTATION
+#define MF_COUNT(counters, field) (++(counters).field)
+#define MF_TIMER_START(name) double name = wall_time_now()
+#define MF_TIMER_STOP(counters, field, name) \
+    ((counters).field += wall_time_now() - name)
+#else
+#define MF_COUNT(counters, field) ((void)0)
+#define MF_TIMER_START(name) ((void)0)
+#define MF_TIMER_STOP(counters, field, name) ((void)0)
+#endif
+
+/*
+ * Returns true if the counters are compiled in
+ */
+inline bool instrumentation_enabled() {
+#ifdef STREAM_BASED_AL_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Monotonic wall time in seconds
+ */
+inline double wall_time_now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Counters and phase timers of one Mondrian tree
+ */
+struct mondrian_counters {
+    unsigned long num_updates;  /**< Calls of MondrianTree::update */
+    unsigned long num_classifications;  /**< Calls of MondrianTree::classify */
+    unsigned long num_splits;  /**< Splits in sample_mondrian_block */
+    unsigned long num_parent_insertions;  /**< Case (2) of
+                                            extend_mondrian_block */
+    unsigned long num_paused_hits;  /**< pause_mondrian() returned true */
+    unsigned long num_update_visits;  /**< Nodes visited during updates */
+    unsigned long num_classify_visits;  /**< Nodes visited during
+                                          classification */
+    unsigned long num_new_classes;  /**< New classes seen by the tree */
+    unsigned long num_depth_steps;  /**< Parent steps to compute node depths */
+    unsigned long num_update_prob_mass;  /**< Calls of
+                                           update_expected_prob_mass */
+    unsigned long num_posterior_updates;  /**< Recomputed node posteriors */
+    double time_extend;  /**< Time spent extending the tree [s] */
+    double time_root_update;  /**< Time spent searching the new root [s] */
+    double time_prob_mass;  /**< Time spent updating probability masses [s] */
+    double time_posterior;  /**< Time spent updating posteriors [s] */
+    double time_classify;  /**< Time spent classifying [s] */
+
+    mondrian_counters();
+    void reset();
+    mondrian_counters& operator+=(const mondrian_counters& other);
+};
+
+/**
+ * Write counters of all trees and their sum as JSON document
+ *
+ * @param os    : Output stream
+ * @param phase : Name of the reported phase (e.g. "train_active")
+ * @param trees : Counters of each tree of the forest
+ */
+void write_counters_json(ostream& os, const string& phase,
+        const vector<mondrian_counters>& trees);
+
+#endif /* STREAM_BASED_AL_INSTRUMENTATION_H_ */
@@ -0,0 +1,118 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_latency.h"
+#include <iomanip>
+#include <algorithm>
+
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Latency histogram
+ */
+LatencyHistogram::LatencyHistogram() :
+    count_(0),
+    max_(0),
+    sum_(0.) {
+}
+
+/*
+ * Values smaller than sub_bucket_count_ are stored exactly. Larger values
+ * are stored in the sub-bucket of their most significant bits.
+ */
+int LatencyHistogram::bucket_index(unsigned long long value) {
+    if (value < (unsigned long long) sub_bucket_count_)
+        return (int) value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - sub_bucket_bits_;
+    int sub_bucket = (int) (value >> shift);  /* in [count, 2*count) */
+    return (shift + 1) * sub_bucket_count_ + (sub_bucket - sub_bucket_count_);
+}
+
+unsigned long long LatencyHistogram::bucket_value(int index) {
+    if (index < sub_bucket_count_)
+        return (unsigned long long) index;
+    int shift = index / sub_bucket_count_ - 1;
+    unsigned long long sub_bucket = index % sub_bucket_count_ +
+        sub_bucket_count_;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(unsigned long long value_ns) {
+    if (counts_.empty())
+        counts_.resize(num_buckets_, 0);
+    counts_[bucket_index(value_ns)]++;
+    count_++;
+    sum_ += value_ns;
+    if (value_ns > max_)
+        max_ = value_ns;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.counts_.empty())
+        return;
+    if (counts_.empty())
+        counts_.resize(num_buckets_, 0);
+    for (int i = 0; i < num_buckets_; i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.max_ > max_)
+        max_ = other.max_;
+}
+
+void LatencyHistogram::reset() {
+    fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    max_ = 0;
+    sum_ = 0.;
+}
+
+double LatencyHistogram::mean() const {
+    if (count_ == 0)
+        return 0.;
+    return sum_ / count_;
+}
+
+unsigned long long LatencyHistogram::percentile(double percentile) const {
+    if (count_ == 0)
+        return 0;
+    /* Rank of the requested value (at least the first value) */
+    unsigned long long rank = (unsigned long long) (percentile / 100. *
+            count_ + 0.5);
+    if (rank < 1)
+        rank = 1;
+    unsigned long long cumulative = 0;
+    for (int i = 0; i < num_buckets_; i++) {
+        cumulative += counts_[i];
+        if (cumulative >= rank) {
+            unsigned long long value = bucket_value(i);
+            return value < max_ ? value : max_;
+        }
+    }
+    return max_;
+}
+
+void LatencyHistogram::print(ostream& os, const string& name) const {
+    os << left << setw(22) << name;
+    os << "count: " << setw(10) << count_;
+    os << fixed << setprecision(2);
+    os << "mean: " << setw(10) << mean() / 1e3;
+    os << "p50: " << setw(10) << percentile(50.) / 1e3;
+    os << "p99: " << setw(10) << percentile(99.) / 1e3;
+    os << "p99.9: " << setw(10) << percentile(99.9) / 1e3;
+    os << "max: " << max_ / 1e3 << " [us]" << endl;
+    os.unsetf(ios::fixed);
+    os << setprecision(6) << right;
+}
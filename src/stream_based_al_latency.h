@@ -0,0 +1,99 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_LATENCY_H_
+#define STREAM_BASED_AL_LATENCY_H_
+
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Monotonic clock in nanoseconds
+ */
+inline unsigned long long monotonic_time_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Latency histogram with logarithmic buckets (HDR-style)
+ *
+ * Every power of two is divided into 2^sub_bucket_bits linear sub-buckets,
+ * so that a recorded value is reproduced with a relative error of at most
+ * 1/2^sub_bucket_bits (~3%) independent of its magnitude. Recording a value
+ * is O(1); the buckets (16 kB) are allocated by the first recorded value.
+ */
+class LatencyHistogram {
+    public:
+        LatencyHistogram();
+        /**
+         * Record one latency value (in nanoseconds)
+         */
+        void record(unsigned long long value_ns);
+        /**
+         * Merge counts of another histogram into this one
+         */
+        void merge(const LatencyHistogram& other);
+        /**
+         * Remove all recorded values
+         */
+        void reset();
+        /**
+         * Return value (in nanoseconds) below which "percentile" percent
+         * of the recorded values lie
+         */
+        unsigned long long percentile(double percentile) const;
+        /**
+         * Print count, mean, p50, p99, p99.9 and max (in microseconds)
+         */
+        void print(ostream& os, const string& name) const;
+
+        inline unsigned long long count() const {return count_;};
+        inline unsigned long long max() const {return max_;};
+        double mean() const;
+        /**
+         * Memory of the buckets in bytes
+         */
+        inline long memory_bytes() const {
+            return long(counts_.capacity() * sizeof(unsigned long long));
+        };
+
+    private:
+        static const int sub_bucket_bits_ = 5;
+        static const int sub_bucket_count_ = 1 << sub_bucket_bits_;
+        static const int num_buckets_ = 64 * sub_bucket_count_;
+
+        vector<unsigned long long> counts_;  /**< Counts of all buckets
+                                               (empty before the first
+                                               value) */
+        unsigned long long count_;  /**< Number of recorded values */
+        unsigned long long max_;  /**< Largest recorded value */
+        double sum_;  /**< Sum of recorded values */
+
+        /**
+         * Bucket index of a value
+         */
+        static int bucket_index(unsigned long long value);
+        /**
+         * Largest value that is mapped to a bucket
+         */
+        static unsigned long long bucket_value(int index);
+};
+
+#endif /* STREAM_BASED_AL_LATENCY_H_ */
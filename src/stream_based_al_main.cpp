@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <sstream>
 #include <iomanip>
+#include <limits>
 /* Armadillo */
 #include <armadillo>
 /* Boost */
@@ -26,6 +27,8 @@
 #include "stream_based_al_data.h"
 #include "stream_based_al_hyperparameters.h"
 #include "stream_based_al_experimenter.h"
+#include "stream_based_al_trace.h"
+#include "stream_based_al_server.h"
 
 /*
  * Help function
@@ -39,8 +42,12 @@ void help() {
     cout << "\t --train : \t Train the classifier." << endl;
     cout << "\t --test  : \t Test the classifier." << endl;
     cout << "\t --confidence: \t Calculates a confidence value for each prediction \n \t\t\t (works but will not be saved in some file)" << endl;
+    cout << "\t --stats : \t Print size and memory statistics of the forest \n \t\t\t during training (see Training.stats_interval)" << endl;
+    cout << "\t --perf : \t Measure hardware performance counters (Linux \n \t\t\t perf_event) per sample during training and testing" << endl;
+    cout << "\t --serve : \t Keep the forest resident (after training) and serve \n \t\t\t requests on the Unix socket Server.socket_path" << endl;
     cout << "\tExamples:" << endl;
     cout << "\t ./StreamBasedAL_MF -c conf/stream_based_al.conf --train --test" << endl;
+    cout << "\t ./StreamBasedAL_MF -c conf/stream_based_al.conf --train --serve" << endl;
 }
 
 int main(int argc, char *argv[]) {
@@ -51,6 +58,7 @@ int main(int argc, char *argv[]) {
     cout << endl;
     /* Program parameters */
     bool training = false, testing = false, conf_value = false;
+    bool print_stats = false, perf_counters = false, serve = false;
 /*---------------------------------------------------------------------------*/
     /*
      * Reading input parameters
@@ -78,6 +86,12 @@ int main(int argc, char *argv[]) {
             testing = true;
         } else if (!strcmp(argv[input_count], "--confidence")) {
             conf_value = true;
+        } else if (!strcmp(argv[input_count], "--stats")) {
+            print_stats = true;
+        } else if (!strcmp(argv[input_count], "--perf")) {
+            perf_counters = true;
+        } else if (!strcmp(argv[input_count], "--serve")) {
+            serve = true;
         } else {
             cout << "\tUnknown input argument: " << argv[input_count];
             cout << ", please try --help for more information." << endl;
@@ -99,6 +113,10 @@ int main(int argc, char *argv[]) {
      */
     /* Load hyperparameters of Mondrian forest */
     Hyperparameters hp(conf_file_name);
+    hp.print_stats_ = print_stats;
+    hp.perf_counters_ = perf_counters;
+    if (hp.trace_file_.length() > 0)
+        tracer.open(hp.trace_file_, hp.trace_sample_interval_);
     
     /* Set the seed of the random number generator*/
     if(hp.user_seed_config_ != 0){
@@ -112,8 +130,15 @@ int main(int argc, char *argv[]) {
     /* Load training and testing data */
     DataSet dataset_train(hp.random_, hp.sort_data_, hp.iterative_);
     DataSet dataset_test;
-    dataset_train.load(hp.train_data_, hp.train_labels_);
-    dataset_test.load(hp.test_data_, hp.test_labels_);
+    /* Training and testing data share the mapping of class labels */
+    LabelDictionary labels;
+    dataset_train.set_label_dictionary(labels);
+    dataset_test.set_label_dictionary(labels);
+    {
+        TraceSpan span("load_data", "data");
+        dataset_train.load(hp.train_data_, hp.train_labels_);
+        dataset_test.load(hp.test_data_, hp.test_labels_);
+    }
     /* Set feature dimension */
     int feat_dim = dataset_train.feature_dim_;
     
@@ -123,14 +148,48 @@ int main(int argc, char *argv[]) {
      */
     mondrian_settings* settings = new mondrian_settings;
     settings->num_trees = hp.num_trees_; 
+    /* Negative budget -> infinite lifetime */
+    settings->init_budget = hp.init_budget_ < 0 ?
+        numeric_limits<float>::infinity() : hp.init_budget_;
     settings->discount_factor = hp.discount_factor_;
     settings->decision_prior_hyperparam = hp.decision_prior_hyperparam_;
     settings->discount_param = settings->discount_factor * float(feat_dim);
     settings->debug = hp.debug_;
+    if (settings->debug && !debug_output(true))
+        cout << "[WARNING] - Mondrian.debug is set, but the debug output is "
+        "not compiled in (make DEBUG_OUTPUT=1)" << endl;
     settings->max_samples_in_one_node = hp.max_samples_in_one_node_;
     settings->confidence_measure = hp.confidence_measure_;
     settings->density_exponent = hp.density_exponent_;
+    settings->validate_interval = hp.validate_interval_;
+    settings->memory_budget = long(hp.memory_budget_) * 1024;
+    settings->forget_half_life = hp.forget_half_life_;
+    settings->num_shards = hp.num_shards_;
+    settings->shard_mode = hp.shard_mode_;
     
+/*---------------------------------------------------------------------------*/
+    /*
+     * Serve a resident forest (trained on the training set first)
+     * ----------------------------------------------------
+     */
+    if (serve) {
+        MondrianForest* forest = new MondrianForest(*settings, feat_dim);
+        if (training) {
+            if (hp.active_learning_ > 0)
+                forest->train_active(dataset_train, hp);
+            else
+                forest->train(dataset_train, hp);
+        }
+        int status = EXIT_SUCCESS;
+        {
+            ForestServer server(*forest, labels, hp);
+            status = server.run();
+        }
+        delete forest;
+        delete settings;
+        tracer.close();
+        return status;
+    }
     
 /*---------------------------------------------------------------------------*/
     
@@ -147,6 +206,7 @@ int main(int argc, char *argv[]) {
         
         for (int j = 0; j < num_query_steps; j++){
             hp.active_max_num_queries_ = ((float)max_num_queries*(j+1))/num_query_steps;
+            TraceSpan run_span("run", "run", true, i * num_query_steps + j);
             
             /* Initialize Mondrian forest */
             MondrianForest* forest = new MondrianForest(*settings, feat_dim);
@@ -236,6 +296,12 @@ int main(int argc, char *argv[]) {
         }
         cout << endl;
         cout << "Average confusion matrix (predicted class vs. actual class):" << endl;
+        if (!labels.is_identity()) {
+            cout << "Class labels of rows/columns:";
+            for (int k = 0; k < labels.size(); k++)
+                cout << " " << labels.to_external(k);
+            cout << endl;
+        }
         cout << avg_confusion_matrix;
     }
 
@@ -244,6 +310,7 @@ int main(int argc, char *argv[]) {
      * Free Space
      */
     delete settings;
+    tracer.close();
 
     return 0;
 }
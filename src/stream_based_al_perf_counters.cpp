@@ -0,0 +1,158 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_perf_counters.h"
+#include "stream_based_al_instrumentation.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+/*---------------------------------------------------------------------------*/
+#ifdef __linux__
+/*
+ * Open one counter of the calling thread (on any CPU); threads created
+ * afterwards inherit it, their counts are added when they exit
+ */
+static int open_counter(unsigned int type, unsigned long long config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Hardware performance counters
+ */
+PerfCounters::PerfCounters(bool enabled) :
+    wall_time_(0.),
+    start_time_(0.) {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        fds_[i] = -1;
+        values_[i] = 0;
+    }
+    if (!enabled) {
+        error_ = "disabled";
+        return;
+    }
+#ifdef __linux__
+    fds_[CYCLES] = open_counter(PERF_TYPE_HARDWARE,
+            PERF_COUNT_HW_CPU_CYCLES);
+    if (fds_[CYCLES] < 0)
+        error_ = strerror(errno);
+    fds_[INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE,
+            PERF_COUNT_HW_INSTRUCTIONS);
+    fds_[L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fds_[LLC_MISSES] = open_counter(PERF_TYPE_HARDWARE,
+            PERF_COUNT_HW_CACHE_MISSES);
+    fds_[BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE,
+            PERF_COUNT_HW_BRANCH_MISSES);
+#else
+    error_ = "perf_event_open is only available on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (fds_[i] >= 0)
+            close(fds_[i]);
+    }
+#endif
+}
+
+bool PerfCounters::available() const {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (fds_[i] >= 0)
+            return true;
+    }
+    return false;
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    start_time_ = wall_time_now();
+}
+
+void PerfCounters::stop() {
+    wall_time_ = wall_time_now() - start_time_;
+#ifdef __linux__
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        values_[i] = 0;
+        if (fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            unsigned long long count = 0;
+            if (read(fds_[i], &count, sizeof(count)) == sizeof(count))
+                values_[i] = count;
+        }
+    }
+#endif
+}
+
+const char* PerfCounters::event_name(int event) {
+    switch (event) {
+        case CYCLES: return "cycles";
+        case INSTRUCTIONS: return "instructions";
+        case L1D_MISSES: return "L1d misses";
+        case LLC_MISSES: return "LLC misses";
+        case BRANCH_MISSES: return "branch misses";
+        default: return "unknown";
+    }
+}
+
+void PerfCounters::print(ostream& os, const string& phase,
+        unsigned long num_samples) const {
+    float n = num_samples > 0 ? float(num_samples) : 1.;
+    os << endl;
+    os << "Hardware counters (" << phase << ", " << num_samples <<
+        " samples):" << endl;
+    os << "  wall time per sample [us]: " << wall_time_ * 1e6 / n << endl;
+    if (!available()) {
+        os << "  not available (" << error_ << "), wall clock only" << endl;
+        return;
+    }
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        os << "  " << event_name(i) << " per sample: ";
+        if (fds_[i] >= 0)
+            os << values_[i] / n << endl;
+        else
+            os << "n/a" << endl;
+    }
+    if (available(CYCLES) && available(INSTRUCTIONS) && values_[CYCLES] > 0)
+        os << "  instructions per cycle: " <<
+            double(values_[INSTRUCTIONS]) / values_[CYCLES] << endl;
+}
@@ -0,0 +1,96 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_PERF_COUNTERS_H_
+#define STREAM_BASED_AL_PERF_COUNTERS_H_
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Hardware performance counters (Linux perf_event_open)
+ *
+ * Counts cycles, instructions, L1 data cache misses, last level cache misses
+ * and branch misses of the calling thread between start() and stop(). The
+ * counters also cover threads created by this thread after the constructor
+ * (e.g. the workers of a sharded forest), but only once they have exited:
+ * stop() must come after the thread pools are destroyed.
+ * Counters that cannot be opened (other operating systems, restricted
+ * containers, perf_event_paranoid, ...) are skipped; if none is available,
+ * only the wall-clock time is reported.
+ */
+class PerfCounters {
+    public:
+        enum Event {
+            CYCLES = 0,
+            INSTRUCTIONS,
+            L1D_MISSES,
+            LLC_MISSES,
+            BRANCH_MISSES,
+            NUM_EVENTS
+        };
+
+        /**
+         * Open all counters (disabled)
+         *
+         * @param enabled   : If false, no counter is opened and only the
+         *                    wall-clock time is measured
+         */
+        PerfCounters(bool enabled = true);
+        ~PerfCounters();
+        /**
+         * Reset and start counting
+         */
+        void start();
+        /**
+         * Stop counting and read the counter values
+         */
+        void stop();
+        /**
+         * Returns true if at least one hardware counter could be opened
+         */
+        bool available() const;
+        /**
+         * Returns true if the counter of "event" is available
+         */
+        inline bool available(Event event) const {return fds_[event] >= 0;};
+        /**
+         * Value of a counter (after stop())
+         */
+        inline unsigned long long value(Event event) const {
+            return values_[event];
+        };
+        /**
+         * Print all counters per processed sample
+         *
+         * @param os            : Output stream
+         * @param phase         : Name of measured phase
+         * @param num_samples   : Number of processed samples
+         */
+        void print(ostream& os, const string& phase,
+                unsigned long num_samples) const;
+
+    private:
+        int fds_[NUM_EVENTS];  /**< File descriptors of the counters */
+        unsigned long long values_[NUM_EVENTS];  /**< Counter values */
+        double wall_time_;  /**< Wall-clock time between start and stop */
+        double start_time_;  /**< Time of start() */
+        string error_;  /**< Reason why counters are not available */
+
+        static const char* event_name(int event);
+};
+
+#endif /* STREAM_BASED_AL_PERF_COUNTERS_H_ */
@@ -14,8 +14,8 @@
 #include "stream_based_al_random.h"
 
 /*---------------------------------------------------------------------------*/
-/* Instantiate global random number generator */
-RandomGenerator rng;
+/* Instantiate random number generator (one per thread) */
+thread_local RandomGenerator rng;
 
 /*---------------------------------------------------------------------------*/
 RandomGenerator::RandomGenerator() :
@@ -0,0 +1,501 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "stream_based_al_server.h"
+
+/* Set by SIGINT and SIGTERM */
+static volatile sig_atomic_t server_stop = 0;
+
+static void handle_stop_signal(int) {
+    server_stop = 1;
+}
+
+/* Bytes read from a connection at once */
+static const int server_read_size = 65536;
+/* Unsent responses at which a connection is no longer read (a client that
+   sends but does not read cannot grow the output without limit) */
+static const size_t server_max_output = 4 << 20;
+/* Poll timeout without pending batch (checks server_stop) */
+static const int server_idle_timeout_ms = 100;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Forest server
+ */
+ForestServer::ForestServer(MondrianForest& forest, LabelDictionary& labels,
+        const Hyperparameters& hp) :
+    forest_(forest),
+    labels_(labels),
+    socket_path_(hp.server_socket_path_),
+    batch_window_ns_((unsigned long long) hp.server_batch_window_ * 1000),
+    max_batch_size_(hp.server_max_batch_size_),
+    snapshot_file_(hp.server_snapshot_file_),
+    snapshot_dir_(snapshot_file_.substr(0, snapshot_file_.rfind('/') + 1)),
+    listen_fd_(-1),
+    batch_start_(0),
+    num_errors_(0),
+    num_batches_(0) {
+    for (int op = 0; op <= server_info; op++)
+        num_requests_[op] = 0;
+}
+
+ForestServer::~ForestServer() {
+    for (unsigned int i = 0; i < connections_.size(); i++) {
+        ::close(connections_[i]->fd);
+        delete connections_[i];
+    }
+    connections_.clear();
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        unlink(socket_path_.c_str());
+    }
+}
+
+bool ForestServer::open_socket() {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        cout << "[ERROR] - ForestServer: socket path too long: " <<
+            socket_path_ << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socket_path_.c_str());
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        cout << "[ERROR] - ForestServer: " << strerror(errno) << endl;
+        return false;
+    }
+    /* Socket file of an earlier server */
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, (sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(listen_fd_, SOMAXCONN) != 0) {
+        cout << "[ERROR] - ForestServer: cannot listen on " <<
+            socket_path_ << ": " << strerror(errno) << endl;
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+int ForestServer::run() {
+    if (!open_socket())
+        return EXIT_FAILURE;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    cout << "Serving on " << socket_path_ << " (batch window: " <<
+        batch_window_ns_ / 1000 << " us, max batch size: " <<
+        max_batch_size_ << ")" << endl;
+
+    vector<pollfd> poll_fds;
+    while (!server_stop) {
+        poll_fds.clear();
+        pollfd listen_poll = {listen_fd_, POLLIN, 0};
+        poll_fds.push_back(listen_poll);
+        for (unsigned int i = 0; i < connections_.size(); i++) {
+            const string& output = connections_[i]->output;
+            pollfd conn_poll = {connections_[i]->fd, short(
+                (output.size() < server_max_output ? POLLIN : 0) |
+                (output.empty() ? 0 : POLLOUT)), 0};
+            poll_fds.push_back(conn_poll);
+        }
+        /* Wake up when the window of the pending batch ends */
+        timespec timeout = {0, server_idle_timeout_ms * 1000000L};
+        if (!batch_requests_.empty()) {
+            unsigned long long waited = monotonic_time_ns() - batch_start_;
+            unsigned long long remaining = waited < batch_window_ns_ ?
+                batch_window_ns_ - waited : 0;
+            timeout.tv_sec = remaining / 1000000000ULL;
+            timeout.tv_nsec = remaining % 1000000000ULL;
+        }
+        int num_ready = ppoll(&poll_fds[0], poll_fds.size(), &timeout, NULL);
+        if (num_ready < 0 && errno != EINTR) {
+            cout << "[ERROR] - ForestServer: " << strerror(errno) << endl;
+            break;
+        }
+        if (num_ready > 0) {
+            /* Connections of this round (accepted ones are polled next) */
+            unsigned int num_connections = poll_fds.size() - 1;
+            for (unsigned int i = 0; i < num_connections; i++) {
+                short events = poll_fds[i + 1].revents;
+                if (events & (POLLIN | POLLHUP | POLLERR))
+                    read_connection(*connections_[i]);
+                if (events & POLLOUT) {
+                    write_connection(*connections_[i]);
+                    /* Requests held back while the output was full */
+                    if (!connections_[i]->input.empty())
+                        handle_requests(*connections_[i]);
+                }
+            }
+            if (poll_fds[0].revents & POLLIN)
+                accept_connections();
+        }
+        if (!batch_requests_.empty() &&
+            monotonic_time_ns() - batch_start_ >= batch_window_ns_)
+            flush_batch();
+        remove_closed_connections();
+    }
+    flush_batch();
+    remove_closed_connections();
+    cout << endl << "Server stopped" << endl;
+    print_stats(cout);
+    return EXIT_SUCCESS;
+}
+
+void ForestServer::accept_connections() {
+    while (true) {
+        int fd = accept(listen_fd_, NULL, NULL);
+        if (fd < 0)
+            return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        connection* conn = new connection;
+        conn->fd = fd;
+        conn->closed = false;
+        connections_.push_back(conn);
+    }
+}
+
+void ForestServer::read_connection(connection& conn) {
+    char buffer[server_read_size];
+    /* At most one request of the largest size is buffered */
+    while (!conn.closed &&
+           conn.input.size() < sizeof(server_request_header) +
+           server_max_payload) {
+        ssize_t num_bytes = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (num_bytes > 0) {
+            conn.input.append(buffer, num_bytes);
+            continue;
+        }
+        if (num_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (num_bytes < 0 && errno == EINTR)
+            continue;
+        /* Peer closed the connection or error */
+        conn.closed = true;
+    }
+    handle_requests(conn);
+}
+
+void ForestServer::handle_requests(connection& conn) {
+    /* Handle the complete requests until the output is full */
+    size_t pos = 0;
+    while (conn.input.size() - pos >= sizeof(server_request_header) &&
+           conn.output.size() < server_max_output) {
+        server_request_header header;
+        memcpy(&header, conn.input.data() + pos, sizeof(header));
+        if (header.length > server_max_payload) {
+            respond_error(conn, header.op, header.id, "payload too large");
+            conn.closed = true;
+            break;
+        }
+        if (conn.input.size() - pos < sizeof(header) + header.length)
+            break;
+        handle_request(conn, header, conn.input.data() + pos +
+                       sizeof(header));
+        pos += sizeof(header) + header.length;
+    }
+    conn.input.erase(0, pos);
+    /* Without window only requests that arrived together are batched */
+    if (batch_window_ns_ == 0)
+        flush_batch();
+    write_connection(conn);
+}
+
+void ForestServer::handle_request(connection& conn,
+        const server_request_header& header, const char* payload) {
+    if (header.op >= server_classify && header.op <= server_info)
+        num_requests_[header.op]++;
+    uint32_t sample_bytes = forest_.get_feature_dim() * sizeof(float);
+    switch (header.op) {
+        case server_classify:
+        case server_classify_confident: {
+            if (header.length != sample_bytes) {
+                respond_error(conn, header.op, header.id,
+                              "wrong feature dimension");
+                return;
+            }
+            Sample sample;
+            sample.x = arma::fvec(forest_.get_feature_dim());
+            memcpy(sample.x.memptr(), payload, sample_bytes);
+            sample.y = -1;
+            if (batch_requests_.empty())
+                batch_start_ = monotonic_time_ns();
+            batched_request request = {&conn, header.op, header.id};
+            batch_samples_.push_back(sample);
+            batch_requests_.push_back(request);
+            if (int(batch_requests_.size()) >= max_batch_size_)
+                flush_batch();
+            return;
+        }
+        case server_update: {
+            if (header.length != sizeof(int32_t) + sample_bytes) {
+                respond_error(conn, header.op, header.id,
+                              "wrong feature dimension");
+                return;
+            }
+            /* Classify requests that arrived earlier see the old forest */
+            flush_batch();
+            int32_t label = 0;
+            memcpy(&label, payload, sizeof(label));
+            Sample sample;
+            sample.x = arma::fvec(forest_.get_feature_dim());
+            memcpy(sample.x.memptr(), payload + sizeof(label), sample_bytes);
+            sample.y = labels_.to_internal(label);
+            forest_.update(sample);
+            respond(conn, header.op, header.id, server_ok, NULL, 0);
+            return;
+        }
+        case server_snapshot: {
+            flush_batch();
+            /* Clients only name a file in the directory of
+               Server.snapshot_file */
+            string filename = snapshot_file_;
+            if (header.length > 0) {
+                string name(payload, header.length);
+                if (name.find_first_of(string("/\0", 2)) != string::npos ||
+                    name == "." || name == "..") {
+                    respond_error(conn, header.op, header.id,
+                                  "snapshot name is not a file name");
+                    return;
+                }
+                filename = snapshot_dir_ + name;
+            }
+            string error;
+            if (!forest_.save(filename, &labels_, &error)) {
+                respond_error(conn, header.op, header.id, error);
+                return;
+            }
+            respond(conn, header.op, header.id, server_ok, NULL, 0);
+            return;
+        }
+        case server_info: {
+            flush_batch();
+            char info[2 * sizeof(int32_t) + sizeof(float)];
+            int32_t feature_dim = forest_.get_feature_dim();
+            int32_t num_classes = labels_.size();
+            float num_samples = forest_.get_data_counter();
+            memcpy(info, &feature_dim, sizeof(feature_dim));
+            memcpy(info + sizeof(int32_t), &num_classes, sizeof(num_classes));
+            memcpy(info + 2 * sizeof(int32_t), &num_samples,
+                   sizeof(num_samples));
+            respond(conn, header.op, header.id, server_ok, info,
+                    sizeof(info));
+            return;
+        }
+        default:
+            respond_error(conn, header.op, header.id, "unknown operation");
+    }
+}
+
+void ForestServer::flush_batch() {
+    if (batch_requests_.empty())
+        return;
+    unsigned long long start_time = monotonic_time_ns();
+    vector<int> classes;
+    vector<pair<int, float> > predictions;
+    forest_.classify_batch(batch_samples_, classes, predictions);
+    for (unsigned int i = 0; i < batch_requests_.size(); i++) {
+        const batched_request& request = batch_requests_[i];
+        int32_t pred_class = -1;
+        float confidence = 0.;
+        if (request.op == server_classify)
+            pred_class = labels_.to_external(classes[i]);
+        if (request.op == server_classify_confident) {
+            pred_class = labels_.to_external(predictions[i].first);
+            confidence = predictions[i].second;
+        }
+        char result[sizeof(int32_t) + sizeof(float)];
+        memcpy(result, &pred_class, sizeof(pred_class));
+        memcpy(result + sizeof(int32_t), &confidence, sizeof(confidence));
+        respond(*request.conn, request.op, request.id, server_ok, result,
+                request.op == server_classify ? sizeof(int32_t) :
+                sizeof(result));
+    }
+    batch_latency_.record(monotonic_time_ns() - start_time);
+    num_batches_++;
+    batch_samples_.clear();
+    batch_requests_.clear();
+}
+
+void ForestServer::write_connection(connection& conn) {
+    size_t pos = 0;
+    while (!conn.closed && pos < conn.output.size()) {
+        ssize_t num_bytes = send(conn.fd, conn.output.data() + pos,
+                                 conn.output.size() - pos, MSG_NOSIGNAL);
+        if (num_bytes > 0) {
+            pos += num_bytes;
+            continue;
+        }
+        if (num_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (num_bytes < 0 && errno == EINTR)
+            continue;
+        conn.closed = true;
+    }
+    conn.output.erase(0, pos);
+}
+
+void ForestServer::respond(connection& conn, uint8_t op, uint32_t id,
+        uint8_t status, const void* payload, uint32_t length) {
+    server_response_header header;
+    memset(&header, 0, sizeof(header));
+    header.op = op;
+    header.status = status;
+    header.id = id;
+    header.length = length;
+    conn.output.append((const char*) &header, sizeof(header));
+    if (length > 0)
+        conn.output.append((const char*) payload, length);
+}
+
+void ForestServer::respond_error(connection& conn, uint8_t op, uint32_t id,
+        const string& message) {
+    /* Keep the order of the responses of the connection */
+    flush_batch();
+    num_errors_++;
+    respond(conn, op, id, server_error, message.data(), message.size());
+}
+
+void ForestServer::remove_closed_connections() {
+    if (!batch_requests_.empty())
+        return;
+    unsigned int num_kept = 0;
+    for (unsigned int i = 0; i < connections_.size(); i++) {
+        connection* conn = connections_[i];
+        if (conn->output.size() > 0 && !conn->closed)
+            write_connection(*conn);
+        if (conn->closed) {
+            ::close(conn->fd);
+            delete conn;
+        } else {
+            connections_[num_kept++] = conn;
+        }
+    }
+    connections_.resize(num_kept);
+}
+
+void ForestServer::print_stats(ostream& os) const {
+    os << "requests: classify: " << num_requests_[server_classify] <<
+        "  classify_confident: " << num_requests_[server_classify_confident]
+        << "  update: " << num_requests_[server_update] << "  snapshot: " <<
+        num_requests_[server_snapshot] << "  info: " <<
+        num_requests_[server_info] << "  errors: " << num_errors_ << endl;
+    long num_classified = num_requests_[server_classify] +
+        num_requests_[server_classify_confident];
+    os << "batches: " << num_batches_ << "  mean batch size: " <<
+        (num_batches_ > 0 ? double(num_classified) / num_batches_ : 0.) <<
+        endl;
+    if (batch_latency_.count() > 0)
+        batch_latency_.print(os, "batch");
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Forest client
+ */
+ForestClient::ForestClient() :
+    fd_(-1) {
+}
+
+ForestClient::~ForestClient() {
+    close();
+}
+
+bool ForestClient::connect(const string& socket_path) {
+    close();
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        return false;
+    strcpy(address.sun_path, socket_path.c_str());
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0)
+        return false;
+    if (::connect(fd_, (sockaddr*) &address, sizeof(address)) != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Write or read exactly "length" bytes
+ */
+static bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t num_bytes = send(fd, data, length, MSG_NOSIGNAL);
+        if (num_bytes < 0 && errno == EINTR)
+            continue;
+        if (num_bytes <= 0)
+            return false;
+        data += num_bytes;
+        length -= num_bytes;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t num_bytes = recv(fd, data, length, 0);
+        if (num_bytes < 0 && errno == EINTR)
+            continue;
+        if (num_bytes <= 0)
+            return false;
+        data += num_bytes;
+        length -= num_bytes;
+    }
+    return true;
+}
+
+bool ForestClient::send_request(uint8_t op, uint32_t id, const void* payload,
+        uint32_t length) {
+    if (fd_ < 0)
+        return false;
+    string request(sizeof(server_request_header) + length, '\0');
+    server_request_header header;
+    memset(&header, 0, sizeof(header));
+    header.op = op;
+    header.id = id;
+    header.length = length;
+    memcpy(&request[0], &header, sizeof(header));
+    if (length > 0)
+        memcpy(&request[sizeof(header)], payload, length);
+    return write_all(fd_, request.data(), request.size());
+}
+
+bool ForestClient::receive_response(server_response_header& header,
+        string& payload) {
+    if (fd_ < 0 || !read_all(fd_, (char*) &header, sizeof(header)))
+        return false;
+    payload.resize(header.length);
+    return header.length == 0 || read_all(fd_, &payload[0], header.length);
+}
+
+void ForestClient::close() {
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+}
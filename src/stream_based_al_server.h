@@ -0,0 +1,243 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_SERVER_H_
+#define STREAM_BASED_AL_SERVER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "stream_based_al_forest.h"
+#include "stream_based_al_data.h"
+#include "stream_based_al_hyperparameters.h"
+#include "stream_based_al_latency.h"
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Binary protocol of the forest server (Unix domain socket, native byte
+ * order)
+ *
+ * A request is a server_request_header followed by "length" bytes:
+ *  classify            : float[feature_dim]
+ *  classify_confident  : float[feature_dim]
+ *  update              : int32 label, float[feature_dim]
+ *  snapshot            : file name in the directory of
+ *                        Server.snapshot_file (empty = Server.snapshot_file)
+ *  info                : -
+ * Every request gets one response with the id of the request; responses
+ * of a connection are sent in the order of its requests. A response is a
+ * server_response_header followed by "length" bytes:
+ *  classify            : int32 class (-1 = forest has not learned yet,
+ *                        -2 = all classes are equally probable)
+ *  classify_confident  : int32 class, float confidence
+ *  update, snapshot    : -
+ *  info                : int32 feature_dim, int32 num_classes,
+ *                        float number of learned samples
+ *  status server_error : error message
+ * Labels and classes are the labels of the client (they are mapped to the
+ * internal indices of the forest by the server).
+ */
+enum server_op {
+    server_classify = 1,
+    server_classify_confident = 2,
+    server_update = 3,
+    server_snapshot = 4,
+    server_info = 5
+};
+
+enum server_status {
+    server_ok = 0,
+    server_error = 1
+};
+
+struct server_request_header {
+    uint8_t op;  /**< server_op */
+    uint8_t reserved[3];
+    uint32_t id;  /**< Returned in the response */
+    uint32_t length;  /**< Bytes of the payload */
+};
+
+struct server_response_header {
+    uint8_t op;  /**< server_op of the request */
+    uint8_t status;  /**< server_status */
+    uint8_t reserved[2];
+    uint32_t id;  /**< Id of the request */
+    uint32_t length;  /**< Bytes of the payload */
+};
+
+/* Largest payload of a request (larger requests close the connection) */
+const uint32_t server_max_payload = 1 << 20;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Keeps a Mondrian forest resident and serves requests over a Unix domain
+ * socket
+ *
+ * All connections are served by one thread (poll loop), so the forest has
+ * a single writer. Classify requests are collected in a batch until
+ * "Server.batch_window" microseconds after the first request of the batch
+ * or until the batch holds "Server.max_batch_size" requests; the batch is
+ * then classified tree by tree (MondrianForest::classify_batch). Update
+ * and snapshot requests first finish the pending batch, so every request
+ * sees the forest as it is after all earlier requests.
+ */
+class ForestServer {
+    public:
+        /**
+         * Serve "forest", mapping the labels of the clients with "labels"
+         */
+        ForestServer(MondrianForest& forest, LabelDictionary& labels,
+                const Hyperparameters& hp);
+        /**
+         * Close all connections and remove the socket
+         */
+        ~ForestServer();
+        /**
+         * Serve requests until SIGINT or SIGTERM
+         *
+         * @return          : EXIT_FAILURE if the socket cannot be opened
+         */
+        int run();
+        /**
+         * Print number of requests, batches and batch latency
+         */
+        void print_stats(ostream& os) const;
+
+    private:
+        /**
+         * Client connection with unparsed input and unsent output
+         */
+        struct connection {
+            int fd;  /**< Socket of the connection */
+            string input;  /**< Received bytes of incomplete requests */
+            string output;  /**< Responses not sent yet */
+            bool closed;  /**< Peer closed or error (removed after the
+                            pending batch) */
+        };
+        /**
+         * Classify request waiting in the batch
+         */
+        struct batched_request {
+            connection* conn;  /**< Connection of the request */
+            uint8_t op;  /**< classify or classify_confident */
+            uint32_t id;  /**< Id of the request */
+        };
+
+        /* The server owns its socket (no copies) */
+        ForestServer(const ForestServer&);
+        ForestServer& operator=(const ForestServer&);
+
+        MondrianForest& forest_;  /**< Served forest */
+        LabelDictionary& labels_;  /**< Labels of the clients */
+        string socket_path_;  /**< Path of the Unix domain socket */
+        unsigned long long batch_window_ns_;  /**< Maximum wait of a batch */
+        int max_batch_size_;  /**< Maximum requests of a batch */
+        string snapshot_file_;  /**< Default snapshot file */
+        string snapshot_dir_;  /**< Directory of the snapshots (with
+                                 trailing '/', empty = working directory) */
+        int listen_fd_;  /**< Listening socket (-1 = not open) */
+        vector<connection*> connections_;  /**< Open connections */
+        vector<Sample> batch_samples_;  /**< Samples of the pending batch */
+        vector<batched_request> batch_requests_;  /**< Requests of the
+                                                    pending batch */
+        unsigned long long batch_start_;  /**< Arrival of the first request
+                                            of the batch */
+        long num_requests_[server_info + 1];  /**< Requests per operation */
+        long num_errors_;  /**< Requests answered with an error */
+        long num_batches_;  /**< Classified batches */
+        LatencyHistogram batch_latency_;  /**< Classification of a batch */
+
+        /**
+         * Create, bind and listen on the socket
+         */
+        bool open_socket();
+        /**
+         * Accept all pending connections
+         */
+        void accept_connections();
+        /**
+         * Read available bytes of a connection and handle all complete
+         * requests
+         */
+        void read_connection(connection& conn);
+        /**
+         * Handle the complete requests of the input of a connection (the
+         * rest stays in the input while the output is full)
+         */
+        void handle_requests(connection& conn);
+        /**
+         * Handle one request
+         */
+        void handle_request(connection& conn,
+                const server_request_header& header, const char* payload);
+        /**
+         * Classify all requests of the pending batch and queue the responses
+         */
+        void flush_batch();
+        /**
+         * Send queued responses as far as the socket accepts them
+         */
+        void write_connection(connection& conn);
+        /**
+         * Queue a response
+         */
+        void respond(connection& conn, uint8_t op, uint32_t id,
+                uint8_t status, const void* payload, uint32_t length);
+        /**
+         * Queue an error response (after the responses of the batch)
+         */
+        void respond_error(connection& conn, uint8_t op, uint32_t id,
+                const string& message);
+        /**
+         * Close and delete connections marked as closed
+         */
+        void remove_closed_connections();
+};
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Blocking client of the forest server (used by the load generator of
+ * StreamBasedAL_bench)
+ */
+class ForestClient {
+    public:
+        ForestClient();
+        ~ForestClient();
+        /**
+         * Connect to the server at "socket_path"
+         */
+        bool connect(const string& socket_path);
+        /**
+         * Send a request (several requests may be sent before the first
+         * response is received)
+         */
+        bool send_request(uint8_t op, uint32_t id, const void* payload,
+                uint32_t length);
+        /**
+         * Receive the next response
+         */
+        bool receive_response(server_response_header& header,
+                string& payload);
+        void close();
+
+    private:
+        ForestClient(const ForestClient&);
+        ForestClient& operator=(const ForestClient&);
+
+        int fd_;  /**< Socket (-1 = not connected) */
+};
+
+#endif /* STREAM_BASED_AL_SERVER_H_ */
@@ -0,0 +1,79 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_thread_pool.h"
+
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Thread pool
+ */
+ThreadPool::ThreadPool(int num_threads) :
+    num_pending_(0),
+    stop_(false) {
+    if (num_threads < 1)
+        num_threads = 1;
+    for (int i = 0; i < num_threads; i++) {
+        workers_.push_back(thread(&ThreadPool::worker_loop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        unique_lock<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    task_available_.notify_all();
+    for (unsigned int i = 0; i < workers_.size(); i++) {
+        workers_[i].join();
+    }
+}
+
+void ThreadPool::submit(const function<void()>& task) {
+    {
+        unique_lock<mutex> lock(mutex_);
+        tasks_.push_back(task);
+        num_pending_++;
+    }
+    task_available_.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> lock(mutex_);
+    while (num_pending_ > 0) {
+        tasks_done_.wait(lock);
+    }
+}
+
+void ThreadPool::worker_loop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(mutex_);
+            while (!stop_ && tasks_.empty()) {
+                task_available_.wait(lock);
+            }
+            if (tasks_.empty())
+                return;
+            task = tasks_.front();
+            tasks_.pop_front();
+        }
+        task();
+        {
+            unique_lock<mutex> lock(mutex_);
+            num_pending_--;
+            if (num_pending_ == 0)
+                tasks_done_.notify_all();
+        }
+    }
+}
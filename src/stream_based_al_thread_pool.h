@@ -0,0 +1,76 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_THREAD_POOL_H_
+#define STREAM_BASED_AL_THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Fixed number of worker threads that run submitted tasks
+ *
+ * Tasks are started in submission order. wait() blocks until all
+ * submitted tasks are finished, so a pool can be reused for several
+ * rounds of tasks.
+ */
+class ThreadPool {
+    public:
+        /**
+         * Start "num_threads" workers (at least one)
+         */
+        explicit ThreadPool(int num_threads);
+        /**
+         * Finish all submitted tasks and stop the workers
+         */
+        ~ThreadPool();
+        /**
+         * Queue task for execution on a worker
+         */
+        void submit(const function<void()>& task);
+        /**
+         * Block until all submitted tasks are finished
+         */
+        void wait();
+        /**
+         * Number of worker threads
+         */
+        inline int size() const {return int(workers_.size());};
+
+    private:
+        /* Workers are bound to this pool (no copies) */
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+
+        vector<thread> workers_;  /**< Worker threads */
+        deque<function<void()> > tasks_;  /**< Queued tasks */
+        mutex mutex_;  /**< Protects tasks_, num_pending_ and stop_ */
+        condition_variable task_available_;  /**< Signals queued tasks */
+        condition_variable tasks_done_;  /**< Signals num_pending_ == 0 */
+        int num_pending_;  /**< Queued and running tasks */
+        bool stop_;  /**< Workers exit when the queue is empty */
+
+        /**
+         * Main loop of a worker thread
+         */
+        void worker_loop();
+};
+
+#endif /* STREAM_BASED_AL_THREAD_POOL_H_ */
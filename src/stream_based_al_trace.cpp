@@ -0,0 +1,110 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#include "stream_based_al_trace.h"
+#include "stream_based_al_instrumentation.h"
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------*/
+/* Instantiate global trace writer */
+TraceWriter tracer;
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Trace writer
+ */
+TraceWriter::TraceWriter() :
+    enabled_(false),
+    sample_interval_(1),
+    origin_(0.) {
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+void TraceWriter::open(const string& filename, int sample_interval) {
+    close();
+    filename_ = filename;
+    sample_interval_ = sample_interval > 0 ? sample_interval : 1;
+    origin_ = wall_time_now();
+    events_.clear();
+    /* Reserve memory to avoid reallocations during training */
+    events_.reserve(1 << 16);
+    enabled_ = true;
+}
+
+double TraceWriter::now() const {
+    return (wall_time_now() - origin_) * 1e6;
+}
+
+void TraceWriter::complete(const char* name, const char* category,
+        double start, double duration, long arg, int thread_id) {
+    if (!enabled_)
+        return;
+    trace_event event = {name, category, start, duration, thread_id, arg};
+    lock_guard<mutex> lock(events_mutex_);
+    events_.push_back(event);
+}
+
+void TraceWriter::close() {
+    if (!enabled_)
+        return;
+    enabled_ = false;
+    ofstream file(filename_.c_str());
+    if (!file) {
+        cout << "[ERROR] - TraceWriter: could not open trace file " <<
+            filename_ << endl;
+        return;
+    }
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+    file.setf(ios::fixed);
+    file.precision(3);
+    for (unsigned int i = 0; i < events_.size(); i++) {
+        const trace_event& e = events_[i];
+        file << "{\"name\": \"" << e.name << "\", \"cat\": \"" <<
+            e.category << "\", \"ph\": \"X\", \"ts\": " << e.start <<
+            ", \"dur\": " << e.duration << ", \"pid\": 1, \"tid\": " <<
+            e.thread_id;
+        if (e.arg >= 0)
+            file << ", \"args\": {\"n\": " << e.arg << "}";
+        file << "}" << (i + 1 < events_.size() ? "," : "") << endl;
+    }
+    file << "]}" << endl;
+    file.close();
+    cout << "Trace with " << events_.size() << " events written to " <<
+        filename_ << endl;
+    events_.clear();
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Trace span
+ */
+TraceSpan::TraceSpan(const char* name, const char* category, bool active,
+        long arg, int thread_id) :
+    name_(name),
+    category_(category),
+    active_(active && tracer.enabled()),
+    arg_(arg),
+    thread_id_(thread_id),
+    start_(0.) {
+    if (active_)
+        start_ = tracer.now();
+}
+
+TraceSpan::~TraceSpan() {
+    if (active_)
+        tracer.complete(name_, category_, start_, tracer.now() - start_,
+                arg_, thread_id_);
+}
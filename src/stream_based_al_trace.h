@@ -0,0 +1,115 @@
+// -*- C++ -*-
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 or the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2016
+ * Dep. Of Computer Science
+ * Technical University of Munich (TUM)
+ *
+ */
+
+#ifndef STREAM_BASED_AL_TRACE_H_
+#define STREAM_BASED_AL_TRACE_H_
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * One complete ("X") event of the Chrome trace event format
+ */
+struct trace_event {
+    const char* name;  /**< Name of the span (string literal) */
+    const char* category;  /**< Category of the span (string literal) */
+    double start;  /**< Start time [us] relative to opening the trace */
+    double duration;  /**< Duration [us] */
+    int thread_id;  /**< Thread the span belongs to */
+    long arg;  /**< Optional argument (e.g. sample index), -1 = none */
+};
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Writes a timeline of training and evaluation phases as Chrome/Perfetto
+ * JSON trace (load it in chrome://tracing or ui.perfetto.dev)
+ *
+ * Events are collected in memory and written when the trace is closed.
+ * Per-sample spans are only recorded for every "sample_interval"-th
+ * sample to keep the overhead low.
+ */
+class TraceWriter {
+    public:
+        TraceWriter();
+        ~TraceWriter();
+        /**
+         * Start tracing into "filename"
+         *
+         * @param filename          : Output file (JSON)
+         * @param sample_interval   : Trace every n-th sample
+         */
+        void open(const string& filename, int sample_interval);
+        /**
+         * Write all recorded events and stop tracing
+         */
+        void close();
+        /**
+         * Returns true if tracing is active
+         */
+        inline bool enabled() const {return enabled_;};
+        /**
+         * Returns true if the spans of sample "i_samp" should be recorded
+         */
+        inline bool trace_sample(long i_samp) const {
+            return enabled_ && i_samp % sample_interval_ == 0;
+        };
+        /**
+         * Current time [us] relative to opening the trace
+         */
+        double now() const;
+        /**
+         * Record a complete span
+         */
+        void complete(const char* name, const char* category, double start,
+                double duration, long arg = -1, int thread_id = 0);
+
+    private:
+        bool enabled_;  /**< Tracing is active */
+        int sample_interval_;  /**< Trace every n-th sample */
+        double origin_;  /**< Time of open() [s] */
+        string filename_;  /**< Output file */
+        vector<trace_event> events_;  /**< Recorded events */
+        mutex events_mutex_;  /**< Protects events_ */
+};
+
+/*---------------------------------------------------------------------------*/
+// Declaration of the global trace writer
+extern TraceWriter tracer;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Records a span from construction to destruction (if "active" and the
+ * global trace writer is enabled)
+ */
+class TraceSpan {
+    public:
+        TraceSpan(const char* name, const char* category, bool active = true,
+                long arg = -1, int thread_id = 0);
+        ~TraceSpan();
+
+    private:
+        const char* name_;
+        const char* category_;
+        bool active_;
+        long arg_;
+        int thread_id_;
+        double start_;
+};
+
+#endif /* STREAM_BASED_AL_TRACE_H_ */
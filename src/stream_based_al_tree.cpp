@@ -8,20 +8,103 @@
 
 #include "stream_based_al_tree.hpp"
 
+/*
+ * Statistics of a Mondrian tree
+ */
+mondrian_tree_stats::mondrian_tree_stats() :
+num_nodes(0),
+num_leaves(0),
+num_paused_leaves(0),
+bytes_nodes(0),
+bytes_bounds(0),
+bytes_histograms(0),
+bytes_pred_prob(0),
+bytes_paused_leaves(0),
+num_collapsed(0),
+bytes_collapsed(0),
+num_forgotten(0) {
+}
+
+void mondrian_tree_stats::add_leaf_depth(int depth) {
+    if (depth >= int(leaf_depths.size()))
+        leaf_depths.resize(depth + 1, 0);
+    leaf_depths[depth]++;
+}
+
+mondrian_tree_stats& mondrian_tree_stats::operator+=(
+                                                     const mondrian_tree_stats& other) {
+    num_nodes += other.num_nodes;
+    num_leaves += other.num_leaves;
+    num_paused_leaves += other.num_paused_leaves;
+    if (other.leaf_depths.size() > leaf_depths.size())
+        leaf_depths.resize(other.leaf_depths.size(), 0);
+    for (unsigned int d = 0; d < other.leaf_depths.size(); d++)
+        leaf_depths[d] += other.leaf_depths[d];
+    bytes_nodes += other.bytes_nodes;
+    bytes_bounds += other.bytes_bounds;
+    bytes_histograms += other.bytes_histograms;
+    bytes_pred_prob += other.bytes_pred_prob;
+    bytes_paused_leaves += other.bytes_paused_leaves;
+    num_collapsed += other.num_collapsed;
+    bytes_collapsed += other.bytes_collapsed;
+    num_forgotten += other.num_forgotten;
+    return *this;
+}
+
+void mondrian_tree_stats::print(ostream& os) const {
+    os << "nodes: " << num_nodes << "  leaves: " << num_leaves <<
+    "  paused leaves: " << num_paused_leaves << "  max depth: " <<
+    max_depth() << endl;
+    os << "memory [kB]: total: " << total_bytes() / 1024. <<
+    "  nodes: " << bytes_nodes / 1024. <<
+    "  bounds: " << bytes_bounds / 1024. <<
+    "  histograms: " << bytes_histograms / 1024. <<
+    "  pred_prob: " << bytes_pred_prob / 1024. <<
+    "  paused leaves: " << bytes_paused_leaves / 1024. << endl;
+    if (num_collapsed > 0)
+        os << "memory governor: collapsed nodes: " << num_collapsed <<
+        "  released [kB]: " << bytes_collapsed / 1024. << endl;
+    if (num_forgotten > 0)
+        os << "forgetting: removed nodes: " << num_forgotten << endl;
+    os << "leaf depths (depth:leaves):";
+    for (unsigned int d = 0; d < leaf_depths.size(); d++) {
+        if (leaf_depths[d] > 0)
+            os << " " << d << ":" << leaf_depths[d];
+    }
+    os << endl;
+}
+
+/*---------------------------------------------------------------------------*/
 /*
  * Mondrian block
  */
+MondrianBlock::MondrianBlock() :
+feature_dim_(1),
+sum_dim_range_(0.),
+kernels_(&get_block_kernels(1)),
+debug_(false) {
+    
+    float* bounds = allocate_bounds();
+    bounds[0] = numeric_limits<float>::infinity();
+    bounds[padded_dim()] = -numeric_limits<float>::infinity();
+    bounds_ = bounds;
+}
+
 MondrianBlock::MondrianBlock(const int& feature_dim,
                              const mondrian_settings& settings) :
 feature_dim_(feature_dim),
-/* Initialize block borders with zeros */
-min_block_dim_(feature_dim, arma::fill::zeros),
-max_block_dim_(feature_dim, arma::fill::zeros),
+sum_dim_range_(0.),
+kernels_(&get_block_kernels(feature_dim)),
 debug_(settings.debug) {
     
-    min_block_dim_.fill(numeric_limits<float>::infinity());
-    max_block_dim_.fill(-numeric_limits<float>::infinity());
-    if (debug_)
+    /* Empty block: boundaries are set by the first point */
+    float* bounds = allocate_bounds();
+    for (int d = 0; d < feature_dim_; d++) {
+        bounds[d] = numeric_limits<float>::infinity();
+        bounds[padded_dim() + d] = -numeric_limits<float>::infinity();
+    }
+    bounds_ = bounds;
+    if (debug_output(debug_))
         cout << "### Init Mondrian Block 1" << endl;
 }
 
@@ -29,27 +112,78 @@ MondrianBlock::MondrianBlock(const int& feature_dim,
                              arma::fvec& min_block_dim, arma::fvec& max_block_dim,
                              const mondrian_settings& settings) :
 feature_dim_(feature_dim),
-min_block_dim_(min_block_dim),
-max_block_dim_(max_block_dim),
+sum_dim_range_(0.),
+kernels_(&get_block_kernels(feature_dim)),
 debug_(settings.debug) {
     
+    float* bounds = allocate_bounds();
+    for (int d = 0; d < feature_dim_; d++) {
+        bounds[d] = min_block_dim[d];
+        bounds[padded_dim() + d] = max_block_dim[d];
+    }
+    bounds_ = bounds;
     update_sum_dim_range();
     
-    if (debug_)
+    if (debug_output(debug_))
         cout << "### Init Mondrian Block 2" << endl;
 }
 
 MondrianBlock::~MondrianBlock() {
-    /* Delete all pointer elements */
+    /* Blocks are deleted with their node (no readers left) */
+    free(bounds_.load());
+    bounds_ = NULL;
+}
+
+/*
+ * Allocate aligned boundary array of both borders
+ */
+float* MondrianBlock::allocate_bounds() const {
+    void* memory = NULL;
+    if (posix_memalign(&memory, block_alignment,
+                       bounds_bytes()) != 0) {
+        cout << "[ERROR] - MondrianBlock: could not allocate block bounds"
+        << endl;
+        exit(EXIT_FAILURE);
+    }
+    float* bounds = static_cast<float*>(memory);
+    /* Padding stays zero, so it never changes a kernel result */
+    for (int d = 0; d < 2 * padded_dim(); d++) {
+        bounds[d] = 0.;
+    }
+    return bounds;
+}
+
+/*
+ * Boundary array to extend: a copy if concurrent readers may use the
+ * current one, otherwise the current array itself
+ */
+float* MondrianBlock::copy_bounds() const {
+    if (epoch_manager.in_place())
+        return bounds_;
+    float* bounds = allocate_bounds();
+    memcpy(bounds, bounds_, bounds_bytes());
+    return bounds;
+}
+
+/*
+ * Publish extended boundaries (readers may still use the old array until
+ * they leave their critical section)
+ */
+void MondrianBlock::publish_bounds(float* bounds) {
+    float* old_bounds = bounds_;
+    if (bounds == old_bounds)
+        return;
+    bounds_ = bounds;
+    epoch_manager.retire(static_cast<void*>(old_bounds), &free);
 }
 
 /**
  * Get maximum and minimum of block dimensions and the current sample
  */
 pair<arma::fvec, arma::fvec> MondrianBlock::get_range_states(const arma::fvec& cur_sample) {
-    arma::fvec min_block_sample = arma::min(min_block_dim_, cur_sample);
-    arma::fvec max_block_sample = arma::max(max_block_dim_, cur_sample);
-    assert(all(max_block_sample >= min_block_sample));
+    arma::fvec min_block_sample = arma::min(get_min_block_dim(), cur_sample);
+    arma::fvec max_block_sample = arma::max(get_max_block_dim(), cur_sample);
+    MF_CHECK(all(max_block_sample >= min_block_sample));
     return pair<arma::fvec, arma::fvec>(min_block_sample, max_block_sample);
 }
 
@@ -65,8 +199,9 @@ float MondrianBlock::get_sum_dim_range(const arma::fvec& cur_sample) {
  * Calculate sum of all dimension = sum( max_block_dim_ - min_block_dim_ )
  */
 void MondrianBlock::update_sum_dim_range() {
-    /* accu: same as to get the sum, regardless of the argument type */
-    sum_dim_range_ = arma::accu(max_block_dim_ - min_block_dim_);
+    const float* bounds = bounds_;
+    sum_dim_range_ = kernels_->sum_range(bounds, bounds + padded_dim(),
+                                         feature_dim_);
 }
 
 /*
@@ -74,24 +209,20 @@ void MondrianBlock::update_sum_dim_range() {
  */
 void MondrianBlock::update_range_states(const arma::fvec& cur_min_dim,
                                         const arma::fvec& cur_max_dim) {
-    if (debug_){
+    if (debug_output(debug_))
         cout << "### [MondrianBlock] - update_range_states" << endl;
-        cout << "min_block_dim_.size() = " << min_block_dim_.size();
-        cout << "max_block_dim_.size() = " << max_block_dim_.size();
-    }
-    if (int(min_block_dim_.size()) == feature_dim_ &&
-        int(max_block_dim_.size()) == feature_dim_) {
-        min_block_dim_ = arma::min(min_block_dim_, cur_min_dim);
-        max_block_dim_ = arma::max(max_block_dim_, cur_max_dim);
-    } else {
-        /* Boundaries are not initialized yet */
-        min_block_dim_ = cur_min_dim;
-        max_block_dim_ = cur_max_dim;
+    float* bounds = copy_bounds();
+    float* min_block_dim = bounds;
+    float* max_block_dim = bounds + padded_dim();
+    for (int d = 0; d < feature_dim_; d++) {
+        min_block_dim[d] = std::min(min_block_dim[d], cur_min_dim[d]);
+        max_block_dim[d] = std::max(max_block_dim[d], cur_max_dim[d]);
     }
+    publish_bounds(bounds);
     
-    if (debug_) {
-        cout << "min: " << min_block_dim_ << endl;
-        cout << "max: " << max_block_dim_ << endl;
+    if (debug_output(debug_)) {
+        cout << "min: " << get_min_block_dim() << endl;
+        cout << "max: " << get_max_block_dim() << endl;
     }
     update_sum_dim_range();
 }
@@ -100,18 +231,15 @@ void MondrianBlock::update_range_states(const arma::fvec& cur_min_dim,
  * Update minimum and maximum of training data at this block
  */
 void MondrianBlock::update_range_states(const arma::fvec& cur_point) {
-    if (debug_)
+    if (debug_output(debug_))
         cout << "### [MondrianBlock] - update_range_states" << endl;
-    if (int(min_block_dim_.size()) == feature_dim_ &&
-        int(max_block_dim_.size()) == feature_dim_) {
-        min_block_dim_ = arma::min(min_block_dim_, cur_point);
-        max_block_dim_ = arma::max(max_block_dim_, cur_point);
-    } else {
-        /* Boundaries are not initialized yet */
-        min_block_dim_ = cur_point;
-        max_block_dim_ = cur_point;
-    }
-    update_sum_dim_range();
+    /* Point inside the block -> boundaries do not change (no copy) */
+    if (!epoch_manager.in_place() && get_outside_sum(cur_point) <= 0)
+        return;
+    float* bounds = copy_bounds();
+    sum_dim_range_ = kernels_->extend(bounds, bounds + padded_dim(),
+                                      cur_point.memptr(), feature_dim_);
+    publish_bounds(bounds);
 }
 
 /*
@@ -123,9 +251,13 @@ std::ostream & operator<<(std::ostream &os, const MondrianBlock &mb) {
      *     << mb.min_block_dim_ << ' '<< mb.max_block_dim_ << ' ' <<
      *     mb.debug_ << ' ';
      */
-    return os << mb.feature_dim_ << mb.sum_dim_range_ <<
-    mb.min_block_dim_ << mb.max_block_dim_
-    << mb.debug_;
+    os << mb.feature_dim_ << mb.sum_dim_range_;
+    const float* bounds = mb.bounds_;
+    for (int d = 0; d < mb.feature_dim_; d++)
+        os << bounds[d] << ' ';
+    for (int d = 0; d < mb.feature_dim_; d++)
+        os << bounds[mb.padded_dim() + d] << ' ';
+    return os << mb.debug_;
 }
 
 
@@ -133,9 +265,9 @@ std::ostream & operator<<(std::ostream &os, const MondrianBlock &mb) {
  * Construct tree node
  */
 MondrianNode::MondrianNode(MondrianTree& mondrian_tree,
-                           int* num_classes, const int& feature_dim,
+                           relaxed<int>* num_classes, const int& feature_dim,
                            const float& budget, MondrianNode& parent_node,
-                           const mondrian_settings& settings, int& depth) :
+                           const mondrian_settings& settings) :
 num_classes_(num_classes),
 data_counter_(0),
 is_leaf_(true),
@@ -143,13 +275,16 @@ split_dim_(0),
 split_loc_(0.),
 max_split_costs_(budget),
 budget_(budget),
+discount_(0.),
+posterior_dirty_(true),
 settings_(&settings),
-depth_(depth),
 decision_distr_param_alpha_(0.),
 decision_distr_param_beta_(0.),
-expected_prob_mass_(0.){
+expected_prob_mass_(0.),
+footprint_(),
+decay_epoch_(mondrian_tree.get_decay_epoch()) {
     
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### Init Mondrian Node 1 " << this << endl;
     /* Initialize Mondrian block */
     mondrian_block_ = new MondrianBlock(feature_dim, settings);
@@ -157,10 +292,11 @@ expected_prob_mass_(0.){
     id_left_child_node_ = NULL;
     id_right_child_node_ = NULL;
     mondrian_tree_ = &mondrian_tree;
-    pred_prob_ = arma::fvec(*num_classes, arma::fill::zeros);
+    pred_prob_ = new arma::fvec(*num_classes + 1, arma::fill::zeros);
     if(id_parent_node_ != NULL){
         mondrian_tree_ = id_parent_node_->mondrian_tree_;
     }
+    account_stats();
 }
 
 /*
@@ -168,10 +304,10 @@ expected_prob_mass_(0.){
  * Mondrian block
  */
 MondrianNode::MondrianNode(MondrianTree& mondrian_tree,
-                           int* num_classes, const int& feature_dim,
+                           relaxed<int>* num_classes, const int& feature_dim,
                            const float& budget, MondrianNode& parent_node,
                            arma::fvec& min_block_dim, arma::fvec& max_block_dim,
-                           const mondrian_settings& settings, int& depth) :
+                           const mondrian_settings& settings) :
 num_classes_(num_classes),
 data_counter_(0),
 is_leaf_(true),  /* Gets false if function set_child_node is called */
@@ -179,13 +315,16 @@ split_dim_(0),
 split_loc_(0.),
 max_split_costs_(budget),
 budget_(budget),
+discount_(0.),
+posterior_dirty_(true),
 settings_(&settings),
-depth_(depth),
 decision_distr_param_alpha_(0.),
 decision_distr_param_beta_(0.),
-expected_prob_mass_(0.){
+expected_prob_mass_(0.),
+footprint_(),
+decay_epoch_(mondrian_tree.get_decay_epoch()) {
     
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### Init Mondrian Node 2 " << this << endl;
     /* Initialize Mondrian block */
     mondrian_block_ = new MondrianBlock(feature_dim, min_block_dim,
@@ -194,10 +333,11 @@ expected_prob_mass_(0.){
     id_left_child_node_ = NULL;
     id_right_child_node_ = NULL;
     mondrian_tree_ = &mondrian_tree;
-    pred_prob_ = arma::fvec(*num_classes, arma::fill::zeros);
+    pred_prob_ = new arma::fvec(*num_classes + 1, arma::fill::zeros);
     if(id_parent_node_ != NULL){
         mondrian_tree_ = id_parent_node_->mondrian_tree_;
     }
+    account_stats();
 }
 
 /*
@@ -205,11 +345,11 @@ expected_prob_mass_(0.){
  * the Mondrian block and one existing child node
  */
 MondrianNode::MondrianNode(MondrianTree& mondrian_tree,
-                           int* num_classes, const int& feature_dim,
+                           relaxed<int>* num_classes, const int& feature_dim,
                            const float& budget, MondrianNode& parent_node,
                            MondrianNode& left_child_node, MondrianNode& right_child_node,
                            arma::fvec& min_block_dim, arma::fvec& max_block_dim,
-                           const mondrian_settings& settings, int& depth) :
+                           const mondrian_settings& settings) :
 num_classes_(num_classes),
 data_counter_(0),
 is_leaf_(false),
@@ -217,13 +357,16 @@ split_dim_(0),
 split_loc_(0.),
 max_split_costs_(budget),
 budget_(budget),
+discount_(0.),
+posterior_dirty_(true),
 settings_(&settings),
-depth_(depth),
 decision_distr_param_alpha_(0.),
 decision_distr_param_beta_(0.),
-expected_prob_mass_(0.){
+expected_prob_mass_(0.),
+footprint_(),
+decay_epoch_(mondrian_tree.get_decay_epoch()) {
     
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### Init Mondrian Node 3 " << this << endl;
     /* Initialize Mondrian block */
     mondrian_block_ = new MondrianBlock(feature_dim, min_block_dim,
@@ -233,29 +376,222 @@ expected_prob_mass_(0.){
     id_left_child_node_ = &left_child_node;
     id_right_child_node_ = &right_child_node;
     mondrian_tree_ = &mondrian_tree;
-    pred_prob_ = arma::fvec(*num_classes, arma::fill::zeros);
+    pred_prob_ = new arma::fvec(*num_classes + 1, arma::fill::zeros);
     if(id_parent_node_ != NULL){
         mondrian_tree_ = id_parent_node_->mondrian_tree_;
     }
+    account_stats();
+}
+
+/*
+ * Construct tree node from a snapshot
+ */
+MondrianNode::MondrianNode(MondrianTree& mondrian_tree,
+                           relaxed<int>* num_classes, const int& feature_dim,
+                           MondrianNode& parent_node,
+                           const mondrian_settings& settings, istream& is,
+                           bool& valid) :
+num_classes_(num_classes),
+data_counter_(0),
+is_leaf_(true),
+split_dim_(0),
+split_loc_(0.),
+max_split_costs_(0.),
+budget_(0.),
+discount_(0.),
+posterior_dirty_(true),
+settings_(&settings),
+decision_distr_param_alpha_(0.),
+decision_distr_param_beta_(0.),
+expected_prob_mass_(0.),
+debug_(settings.debug),
+footprint_(),
+decay_epoch_(0) {
+    
+    uint8_t is_leaf = 1, posterior_dirty = 1, has_pred_prob = 0;
+    uint64_t decay_epoch = 0;
+    valid = read_binary(is, is_leaf) && read_binary(is, data_counter_) &&
+    read_binary(is, split_dim_) && read_binary(is, split_loc_) &&
+    read_binary(is, max_split_costs_) && read_binary(is, budget_) &&
+    read_binary(is, discount_) && read_binary(is, posterior_dirty) &&
+    read_binary(is, decision_distr_param_alpha_) &&
+    read_binary(is, decision_distr_param_beta_) &&
+    read_binary(is, expected_prob_mass_) && read_binary(is, decay_epoch);
+    is_leaf_ = (is_leaf != 0);
+    posterior_dirty_ = (posterior_dirty != 0);
+    decay_epoch_ = decay_epoch;
+    if (split_dim_ < 0 || split_dim_ >= feature_dim)
+        valid = false;
+    /* Initialize Mondrian block */
+    arma::fvec min_block_dim(feature_dim, arma::fill::zeros);
+    arma::fvec max_block_dim(feature_dim, arma::fill::zeros);
+    for (int d = 0; d < feature_dim && valid; d++)
+        valid = read_binary(is, min_block_dim[d]);
+    for (int d = 0; d < feature_dim && valid; d++)
+        valid = read_binary(is, max_block_dim[d]);
+    mondrian_block_ = new MondrianBlock(feature_dim, min_block_dim,
+                                        max_block_dim, settings);
+    /* Histogram: nonzero (label, count) entries */
+    int32_t num_entries = 0;
+    valid = valid && read_binary(is, num_entries) && num_entries >= 0 &&
+    num_entries <= *num_classes;
+    for (int i = 0; i < num_entries && valid; i++) {
+        int32_t label = 0;
+        uint32_t count = 0;
+        valid = read_binary(is, label) && read_binary(is, count) &&
+        label >= 0 && label < *num_classes;
+        if (valid && count > 0)
+            count_labels_.increment(label, count);
+    }
+    /*
+     * Cached posterior (missing on paused leaves of older snapshots): the
+     * snapshot stores the full posterior, the cache is recomputed by
+     * MondrianTree::load
+     */
+    valid = valid && read_binary(is, has_pred_prob);
+    float value = 0.f;
+    for (int k = 0; k < *num_classes && valid && has_pred_prob; k++)
+        valid = read_binary(is, value);
+    pred_prob_ = new arma::fvec(*num_classes + 1, arma::fill::zeros);
+    posterior_dirty_ = true;
+    id_parent_node_ = &parent_node;
+    id_left_child_node_ = NULL;
+    id_right_child_node_ = NULL;
+    mondrian_tree_ = &mondrian_tree;
+    account_stats();
+}
+
+/*
+ * Write the state of the current node to a snapshot (read back by the
+ * constructor above, in the same order)
+ */
+void MondrianNode::save(ostream& os) const {
+    write_binary(os, uint8_t(is_leaf_.load()));
+    write_binary(os, data_counter_);
+    write_binary(os, split_dim_);
+    write_binary(os, split_loc_);
+    write_binary(os, max_split_costs_);
+    write_binary(os, budget_);
+    write_binary(os, discount_);
+    write_binary(os, uint8_t(posterior_dirty_.load()));
+    write_binary(os, decision_distr_param_alpha_);
+    write_binary(os, decision_distr_param_beta_);
+    write_binary(os, expected_prob_mass_);
+    write_binary(os, uint64_t(decay_epoch_));
+    const arma::fvec min_block_dim = mondrian_block_->get_min_block_dim();
+    const arma::fvec max_block_dim = mondrian_block_->get_max_block_dim();
+    for (unsigned int d = 0; d < min_block_dim.n_elem; d++)
+        write_binary(os, min_block_dim[d]);
+    for (unsigned int d = 0; d < max_block_dim.n_elem; d++)
+        write_binary(os, max_block_dim[d]);
+    write_binary(os, int32_t(count_labels_.num_entries()));
+    for (int i = 0; i < count_labels_.num_entries(); i++) {
+        write_binary(os, int32_t(count_labels_.label(i)));
+        write_binary(os, uint32_t(count_labels_.count_at(i)));
+    }
+    const arma::fvec* pred_prob = pred_prob_;
+    write_binary(os, uint8_t(pred_prob != NULL));
+    if (pred_prob != NULL) {
+        /* Full posterior over the current number of classes */
+        arma::fvec posterior(*num_classes_, arma::fill::zeros);
+        add_posterior(*pred_prob, 1.f, posterior);
+        for (int k = 0; k < *num_classes_; k++)
+            write_binary(os, posterior[k]);
+    }
 }
 
 MondrianNode::~MondrianNode() {
-    /* Delete all pointer elements */
+    /*
+     * Delete all nodes of the subtree (iteratively): every node is
+     * detached from its children before it is deleted, so the destructor
+     * never recurses
+     */
     if (!is_leaf_) {
-        delete id_left_child_node_;
-        id_left_child_node_ = NULL;
-        delete id_right_child_node_;
+        vector<MondrianNode*> node_stack;
+        node_stack.push_back(id_left_child_node_);
+        node_stack.push_back(id_right_child_node_);
         id_left_child_node_ = NULL;
+        id_right_child_node_ = NULL;
+        while (!node_stack.empty()) {
+            MondrianNode* node = node_stack.back();
+            node_stack.pop_back();
+            if (node == NULL)
+                continue;
+            if (!node->is_leaf_) {
+                node_stack.push_back(node->id_left_child_node_);
+                node_stack.push_back(node->id_right_child_node_);
+                node->id_left_child_node_ = NULL;
+                node->id_right_child_node_ = NULL;
+                node->is_leaf_ = true;
+            }
+            delete node;
+        }
     }
+    /* Remove node from the statistics of the tree */
+    account_stats(true);
+    delete pred_prob_;
+    pred_prob_ = NULL;
     /* Delete mondrian block */
     delete mondrian_block_;
     mondrian_block_ = NULL;
 }
 
+/*
+ * Update the statistics of the tree with the current state of the node
+ */
+void MondrianNode::account_stats(bool remove) {
+    /* Collapsed nodes left the statistics before they were retired */
+    if (remove && !footprint_.counted)
+        return;
+    mondrian_tree_stats& stats = mondrian_tree_->stats_;
+    mondrian_node_footprint cur = mondrian_node_footprint();
+    if (!remove) {
+        cur.counted = true;
+        cur.leaf = is_leaf_;
+        cur.paused = is_leaf_ && check_if_same_labels();
+        cur.node_bytes = sizeof(MondrianNode) - sizeof(LabelHistogram) +
+        sizeof(MondrianBlock);
+        cur.bounds_bytes = mondrian_block_->bounds_bytes();
+        cur.hist_bytes = count_labels_.memory_bytes();
+        cur.pred_bytes = sizeof(arma::fvec) + pred_prob_->n_elem *
+        sizeof(float);
+    }
+    const mondrian_node_footprint& old = footprint_;
+    stats.num_nodes += int(cur.counted) - int(old.counted);
+    stats.num_leaves += int(cur.leaf) - int(old.leaf);
+    stats.num_paused_leaves += int(cur.paused) - int(old.paused);
+    stats.bytes_nodes += cur.node_bytes - old.node_bytes;
+    stats.bytes_bounds += cur.bounds_bytes - old.bounds_bytes;
+    stats.bytes_histograms += cur.hist_bytes - old.hist_bytes;
+    stats.bytes_pred_prob += cur.pred_bytes - old.pred_bytes;
+    long cur_paused_bytes = cur.paused ? cur.node_bytes + cur.bounds_bytes +
+    cur.hist_bytes + cur.pred_bytes : 0;
+    long old_paused_bytes = old.paused ? old.node_bytes + old.bounds_bytes +
+    old.hist_bytes + old.pred_bytes : 0;
+    stats.bytes_paused_leaves += cur_paused_bytes - old_paused_bytes;
+    footprint_ = cur;
+}
+
 /*
  * Print information of current node
  */
 void MondrianNode::print_info() {
+    vector<MondrianNode*> node_stack(1, this);
+    while (!node_stack.empty()) {
+        MondrianNode* node = node_stack.back();
+        node_stack.pop_back();
+        node->print_node_info();
+        if (node->id_right_child_node_ != NULL)
+            node_stack.push_back(node->id_right_child_node_);
+        if (node->id_left_child_node_ != NULL)
+            node_stack.push_back(node->id_left_child_node_);
+    }
+}
+
+/*
+ * Print information of current node only
+ */
+void MondrianNode::print_node_info() {
     cout << endl;
     cout << "-------------------" << endl;
     cout << "node: " << this << endl;
@@ -281,67 +617,91 @@ void MondrianNode::print_info() {
     cout << "left child:    " << id_left_child_node_ << endl;
     cout << "right child:   " << id_right_child_node_ << endl;
     cout << endl;
-    if (id_left_child_node_ != NULL)
-        id_left_child_node_->print_info();
-    if (id_right_child_node_ != NULL)
-        id_right_child_node_->print_info();
-    
 }
 
 /*
- * Update histogram with additional class and increase class histogram +1
+ * Return histogram with one entry per known class
+ * (classes that have not been seen at this node are zero)
  */
-void MondrianNode::add_new_class() {
-    if (settings_->debug)
-        cout << "### add_new_class" << endl;
-    /* Size of count_labels should be one smaller than num_classes */
-    assert(*num_classes_ > int(count_labels_.size()));
-    if (*num_classes_ >= int(count_labels_.size())) {
-        //count_labels_.push_back(0);
-        //count_labels_.resize(count_labels_.size()+1);
-        count_labels_.resize(*num_classes_);
-        pred_prob_.resize(*num_classes_);
-    }
-    /* Update child nodes */
-    if (id_left_child_node_ != NULL) {
-        id_left_child_node_->add_new_class();
-    }
-    if (id_right_child_node_ != NULL) {
-        id_right_child_node_->add_new_class();
+arma::Col<arma::uword> MondrianNode::get_count_labels() const {
+    arma::Col<arma::uword> cnt(*num_classes_, arma::fill::zeros);
+    for (int i = 0; i < count_labels_.num_entries(); i++) {
+        if (count_labels_.label(i) < *num_classes_)
+            cnt[count_labels_.label(i)] = count_labels_.count_at(i);
     }
+    return cnt;
+}
+
+/*
+ * Number of classes with at least one data point at this node
+ */
+int MondrianNode::num_labels_seen() const {
+    return count_labels_.num_entries();
 }
 
 /*
  * Predict class of current sample
+ *
+ * Walks down the path of the sample (iteratively) and adds the
+ * contribution of every node on the path to "pred_prob".
  */
 int MondrianNode::classify(Sample& sample, arma::fvec& pred_prob,
                                 float& prob_not_separated_yet, mondrian_confidence& m_conf) {
     
-    if (settings_->debug)
-        cout << "classify..." << endl;
+    MondrianNode* node = this;
+    while (node != NULL) {
+        node = node->classify_node(sample, pred_prob, prob_not_separated_yet,
+                                   m_conf);
+    }
     int pred_class = -1;
+    /* Get class with highest probability */
+    /* Check if all classes have same probability -> return -2 */
+    if (equal_elements(pred_prob))
+        return -2;
+    float tmp_value = 0.;
+    for (int i = 0; i < int(pred_prob.size()); i++) {
+        if (pred_prob[i] > tmp_value) {
+            tmp_value = pred_prob[i];
+            pred_class = i;
+        }
+    }
+    
+    
+    assert(pred_class > -1);
+    
+    return pred_class;
+}
+
+/*
+ * Add contribution of current node to the prediction of the sample and
+ * return the child node on the path of the sample (NULL at a leaf)
+ */
+MondrianNode* MondrianNode::classify_node(Sample& sample, arma::fvec& pred_prob,
+                                          float& prob_not_separated_yet, mondrian_confidence& m_conf) {
+    
+    MF_COUNT(mondrian_tree_->counters_, num_classify_visits);
+    if (debug_output(settings_->debug))
+        cout << "classify..." << endl;
     /*
      * If x lies outside B^x_j at node j, the probability that x will branch
      * off into its own node at node j, denoted by p^s_j(x), is equal to the
      * probability that a split exists in B_j outside B^x_j
      */
-    int feature_dimension = mondrian_block_->get_feature_dim();
-    arma::fvec zero_vec(feature_dimension, arma::fill::zeros);
     /* \eta_j(x) */
-    float expo_param = 1.0;
-    expo_param = arma::accu(arma::max(zero_vec,
-                                      (sample.x - mondrian_block_->get_max_block_dim()))) +
-    arma::accu(arma::max(zero_vec,
-                         (mondrian_block_->get_min_block_dim() - sample.x)));
+    float expo_param = mondrian_block_->get_outside_sum(sample.x);
+    /* A concurrent update may split or collapse the node */
+    bool is_leaf = is_leaf_;
     /* Compute mondrian confidence values */
-    if (is_leaf_) {
+    if (is_leaf) {
         /* 1. Compute euclidean distance */
-        m_conf.distance = arma::norm(arma::max(zero_vec,
-                                               (sample.x - mondrian_block_->get_max_block_dim())),2) +
-        arma::norm(arma::max(zero_vec,
-                             (mondrian_block_->get_min_block_dim() - sample.x)),2);
-        /* 2. Get number of samples at current node */
-        m_conf.number_of_points = (int) arma::accu(id_parent_node_->count_labels_);
+        m_conf.distance = mondrian_block_->get_outside_distance(sample.x);
+        /*
+         * 2. Get number of samples at current node (the root is a leaf
+         * before the first split or after forgetting)
+         */
+        MondrianNode* parent = id_parent_node_;
+        m_conf.number_of_points = (int) (parent != NULL ?
+            parent->count_labels_.total() : count_labels_.total());
         /* 3. Calculate normalized density at leaf */
         m_conf.normalized_density =
         expected_prob_mass_/mondrian_tree_->get_max_prob_mass_leaf()->expected_prob_mass_;
@@ -349,96 +709,131 @@ int MondrianNode::classify(Sample& sample, arma::fvec& pred_prob,
     /* Probability that x_i will branch off into its own node at node j */
     float prob_not_separated_now = exp(-expo_param * max_split_costs_);
     float prob_separated_now = 1 - prob_not_separated_now;  /* p^s_j(x) */
-    if (settings_->debug) {
+    if (debug_output(settings_->debug)) {
         cout << "prob_not_separated_now: " << prob_not_separated_now << endl;
         cout << "prob_separated_now: " << prob_separated_now << endl;
     }
-    arma::fvec base = get_prior_mean();
-    
-    float discount = exp(-settings_->discount_param * max_split_costs_);
-    
-    if (settings_->debug)
-        cout << "discount: " << discount << endl;
-    /* Interpolated Kneser Ney smoothing */
-    arma::Col<arma::uword> cnt(*num_classes_, arma::fill::zeros);
-    if (is_leaf_) {
-        cnt = count_labels_;
-    } else {
-        arma::Col<arma::uword> ones_vec(*num_classes_, arma::fill::ones);
-        cnt = arma::min(count_labels_, ones_vec);
-    }
+    if (debug_output(settings_->debug))
+        cout << "discount: " << discount_ << endl;
+    /*
+     * Interpolated Kneser Ney smoothing: the posterior of the node is
+     * cached in pred_prob_ and only recomputed when the node is updated
+     * (see update_posterior).
+     */
+    arma::fvec posterior_tmp;
     
     /* Check if denominator is > 0*/
     if (-expm1(-expo_param * max_split_costs_) > 0) {
-        /*
-         * Compute expected discount d, where \delta is drawn from a truncated
-         * exponential with rate \eta_j(x), truncated to the interval
-         * [0, \delta]
-         */
-        arma::fvec cnt_f = arma::conv_to<arma::fvec>::from(cnt);
-        arma::fvec ones_vec(cnt_f.size(),arma::fill::ones);
-        arma::fvec num_tables_k = arma::min(cnt_f, ones_vec);
-        float num_customers = float(arma::sum(cnt));
-        float num_tables = float(arma::sum(num_tables_k));
-        
-        /*
-         * Expected discount is averaging over time of cut which is
-         * a truncated exponential
-         */
         assert(max_split_costs_ >= 0);
-        if(max_split_costs_ == 0) //TODO: Check whether max_split_costs == 0 can exist
-            discount =
-            discount = (expo_param / (expo_param + settings_->discount_param)) *
-            (-expm1(-(expo_param + settings_->discount_param) * max_split_costs_)) /
-            (-expm1(-expo_param * max_split_costs_));
-        
-        assert(num_customers > 0);
-        float discount_per_num_customers = discount / num_customers;
-        arma::fvec pred_prob_tmp = (num_tables * discount_per_num_customers *
-                                    base) + (cnt_f / num_customers) - (discount_per_num_customers *
-                                                                       num_tables_k);
-        
-        pred_prob += prob_separated_now * prob_not_separated_yet * pred_prob_tmp;
+        const arma::fvec& posterior = get_posterior(posterior_tmp);
+        add_posterior(posterior, prob_separated_now * prob_not_separated_yet,
+                      pred_prob);
         prob_not_separated_yet *= prob_not_separated_now;
         
         // Test for NaN
-        assert(all(pred_prob == pred_prob));
+        MF_CHECK(all(pred_prob == pred_prob));
     }
     /* c_j,k: number of customers at restaurant j eating dish k */
     /* Compute posterior mean normalized stable */
-    if (!is_leaf_) {
+    if (!is_leaf) {
         assert(split_dim_ >= 0 && split_dim_ < sample.x.n_elem);
+        MondrianNode* child_node = NULL;
         if (sample.x[split_dim_] <= split_loc_) {
-            if (settings_->debug)
+            if (debug_output(settings_->debug))
                 cout << "left" << endl;
-            pred_class = id_left_child_node_->classify(sample, pred_prob,
-                                                            prob_not_separated_yet, m_conf);
+            child_node = id_left_child_node_;
         } else {
-            if (settings_->debug)
+            if (debug_output(settings_->debug))
                 cout << "right" << endl;
-            pred_class = id_right_child_node_->classify(sample, pred_prob,
-                                                             prob_not_separated_yet, m_conf);
+            child_node = id_right_child_node_;
         }
-    } else if (is_leaf_ && (expo_param <= 0)) {
-        pred_prob = compute_posterior_mean_normalized_stable(
-                                                             cnt, discount, base) * prob_not_separated_yet;
+        /* NULL if the node was collapsed by a concurrent update */
+        if (child_node != NULL)
+            return child_node;
     }
-    /* Get class with highest probability */
-    /* Check if all classes have same probability -> return -2 */
-    if (equal_elements(pred_prob))
-        return -2;
-    float tmp_value = 0.;
-    for (int i = 0; i < int(pred_prob.size()); i++) {
-        if (pred_prob[i] > tmp_value) {
-            tmp_value = pred_prob[i];
-            pred_class = i;
-        }
+    if (expo_param <= 0) {
+        const arma::fvec& posterior = get_posterior(posterior_tmp);
+        pred_prob.zeros();
+        add_posterior(posterior, prob_not_separated_yet, pred_prob);
     }
-    
-    
-    assert(pred_class > -1);
-    
-    return pred_class;
+    return NULL;
+}
+
+/*
+ * Add "weight" times a posterior to the class probabilities "pred_prob"
+ * (the uniform part is spread over pred_prob.n_elem classes)
+ */
+void MondrianNode::add_posterior(const arma::fvec& posterior, float weight,
+                                 arma::fvec& pred_prob) {
+    /* The last element is the weight of the uniform distribution */
+    arma::uword num_seen = posterior.n_elem - 1;
+    float uniform = posterior[num_seen] / pred_prob.n_elem;
+    /* Sizes differ if a concurrent update added a class */
+    arma::uword n = min(pred_prob.n_elem, num_seen);
+    for (arma::uword i = 0; i < n; i++)
+        pred_prob[i] += weight * (posterior[i] + uniform);
+    for (arma::uword i = n; i < pred_prob.n_elem; i++)
+        pred_prob[i] += weight * uniform;
+}
+
+/*
+ * Compare two posteriors (missing classes of the shorter one are zero)
+ */
+bool MondrianNode::equal_posteriors(const arma::fvec& a,
+                                    const arma::fvec& b) {
+    if (a[a.n_elem - 1] != b[b.n_elem - 1])
+        return false;
+    arma::uword n = max(a.n_elem, b.n_elem) - 1;
+    for (arma::uword i = 0; i < n; i++) {
+        float a_i = i < a.n_elem - 1 ? a[i] : 0.f;
+        float b_i = i < b.n_elem - 1 ? b[i] : 0.f;
+        if (a_i != b_i)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Return the cached posterior of the node (or the prior mean in "tmp" if
+ * it was not computed yet)
+ */
+const arma::fvec& MondrianNode::get_posterior(arma::fvec& tmp) {
+    /*
+     * The flag is only set on nodes that were never computed, and it is
+     * cleared after the posterior is published
+     */
+    bool dirty = posterior_dirty_;
+    arma::fvec* posterior = pred_prob_;
+    if (!dirty)
+        return *posterior;
+    /* Node of a concurrent update (posterior not computed yet) */
+    tmp = get_prior_mean();
+    return tmp;
+}
+
+/*
+ * Recompute discount and cached posterior of the current node
+ */
+bool MondrianNode::update_posterior() {
+    MF_COUNT(mondrian_tree_->counters_, num_posterior_updates);
+    discount_ = exp(-settings_->discount_param * max_split_costs_);
+    arma::fvec base = get_prior_mean();
+    arma::fvec posterior = compute_posterior_mean_normalized_stable(
+                                                                    count_labels_, discount_, base, !is_leaf_);
+    arma::fvec* old_posterior = pred_prob_;
+    /* A new class alone does not change the posterior */
+    bool changed = posterior_dirty_ ||
+    !equal_posteriors(posterior, *old_posterior);
+    if (changed && epoch_manager.in_place()) {
+        /* No concurrent readers (grows the vector in place) */
+        *old_posterior = posterior;
+    } else if (changed) {
+        /* Concurrent readers keep using the old vector */
+        pred_prob_ = new arma::fvec(posterior);
+        epoch_manager.retire(old_posterior);
+    }
+    posterior_dirty_ = false;
+    return changed;
 }
 
 /*
@@ -446,22 +841,24 @@ int MondrianNode::classify(Sample& sample, arma::fvec& pred_prob,
  */
 MondrianNode* MondrianNode::update_root_node() {
     
-    if (id_parent_node_ != NULL) {
-        return id_parent_node_->update_root_node();
-    } else {
-        return this;
+    MondrianNode* node = this;
+    while (node->id_parent_node_ != NULL) {
+        node = node->id_parent_node_;
     }
+    return node;
 }
 
 /*
  * Update current data sample
  */
 void MondrianNode::update(const Sample& sample) {
+    decay_counts();
     /*
      * Additional check for the case that less than
-     * two data points passed by at the root node
+     * two data points passed by at the root node (a forgotten internal
+     * root node keeps its split)
      */
-    if (id_parent_node_ == NULL && data_counter_ < 1) {
+    if (id_parent_node_ == NULL && is_leaf_ && data_counter_ < 1) {
         mondrian_block_->update_range_states(sample.x);
         sample_mondrian_block(sample); /* Set max_split_cost */
         add_training_point_to_node(sample);
@@ -475,15 +872,12 @@ void MondrianNode::update(const Sample& sample) {
  * - go through vector count_labels_ and check if only one element is > 1
  */
 bool MondrianNode::check_if_same_labels() {
-    if (settings_->debug){
+    if (debug_output(settings_->debug)){
         cout << "### pause_mondrian()" << endl;
     }
     bool same_labels = false;
-    /* Function "count" returns number of values that are zero */
-    assert(all(count_labels_ >= 0));
-    arma::Col<arma::uword> zero_elem = arma::find(count_labels_ < 1);
-    if (zero_elem.size() == (static_cast<unsigned int>(count_labels_.size()-1)) ||
-        count_labels_.size() <= 1) {
+    /* Only classes with data points are stored in the histogram */
+    if (num_labels_seen() == 1 || *num_classes_ <= 1) {
         same_labels = true;
     }
     if (settings_->max_samples_in_one_node > 0) {
@@ -499,23 +893,21 @@ bool MondrianNode::check_if_same_labels() {
  * Checks if all labels and the current point in a node are identical
  */
 bool MondrianNode::check_if_same_labels(const Sample& sample){
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### check_same_labels(sample)" << endl;
     bool same_labels = false;
-    /* Function "count" returns number of values that are zero */
-    arma::Col<arma::uword> zero_elem = arma::find(count_labels_ < 1);
-    unsigned int count_val = (unsigned int) zero_elem.size();
-    if (count_val == (unsigned int)count_labels_.size()) {
+    int num_nonzero = num_labels_seen();
+    if (num_nonzero == 0) {
         /* All elements are zero */
         same_labels = true;
-    } else if (count_val == (static_cast<unsigned int>(count_labels_.size()-1))) {
+    } else if (num_nonzero == 1) {
         same_labels = true; /* Is true if only one value is greater than 0 */
         /*
          * Check if the only label of the current node has the same label
          * as the label of the current sample
          */
-        if (count_labels_.size() > 1) {
-            if (count_labels_[sample.y] > 0) {
+        if (*num_classes_ > 1) {
+            if (count_labels_.count(sample.y) > 0) {
                 same_labels = true;
             } else {
                 same_labels = false;
@@ -523,7 +915,7 @@ bool MondrianNode::check_if_same_labels(const Sample& sample){
         }
     }
     
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### " << same_labels << endl;
     return same_labels;
 }
@@ -533,7 +925,10 @@ bool MondrianNode::check_if_same_labels(const Sample& sample){
  * - pause if all labels in a node are identical
  */
 bool MondrianNode::pause_mondrian() {
-    return check_if_same_labels();
+    bool paused = check_if_same_labels();
+    if (paused)
+        MF_COUNT(mondrian_tree_->counters_, num_paused_hits);
+    return paused;
 }
 
 /*
@@ -541,12 +936,12 @@ bool MondrianNode::pause_mondrian() {
  */
 void MondrianNode::update_posterior_node_incremental(const Sample& sample) {
     /*
-     * Size of count_labels_ has to be greater than current value of
-     * sample.y -> Else: current element of count_labels does not exist
+     * Histograms only store the classes seen at this node so far
+     * -> a new entry is added if sample.y is the first point of its class
      */
     ++data_counter_;
-    assert(int(count_labels_.size()) > sample.y);
-    count_labels_[sample.y] += 1;
+    count_labels_.increment(sample.y);
+    account_stats();
 }
 
 /*
@@ -555,12 +950,8 @@ void MondrianNode::update_posterior_node_incremental(const Sample& sample) {
 void MondrianNode::init_update_posterior_node_incremental(
                                                           MondrianNode* node_id, const Sample& sample) {
     if (node_id == NULL) {
-        /*
-         * Initialize histogram of current node with zeros.
-         * Size of histogram depends on current number of classes.
-         */
-        count_labels_ = arma::Col<arma::uword>(*num_classes_,
-                                               arma::fill::zeros);
+        /* Initialize empty histogram (grows with the classes seen) */
+        count_labels_.clear();
         data_counter_ = 0;
     } else {
         /* Copy histogram of node "node_id" */
@@ -577,17 +968,14 @@ void MondrianNode::init_update_posterior_node_incremental(
 void MondrianNode::init_update_posterior_node_incremental(
                                                           MondrianNode* node_id) {
     if (node_id == NULL) {
-        /*
-         * Initialize histogram of current node with zeros.
-         * Size of histogram depends on current number of classes.
-         */
-        count_labels_ = arma::Col<arma::uword>(*num_classes_,
-                                               arma::fill::zeros);
+        /* Initialize empty histogram (grows with the classes seen) */
+        count_labels_.clear();
         data_counter_ = 0;
     } else {
         count_labels_ = node_id->count_labels_;
         data_counter_ = node_id->data_counter_;
     }
+    account_stats();
 }
 
 /*
@@ -603,7 +991,7 @@ void MondrianNode::add_training_point_to_node(const Sample& sample) {
  */
 std::pair<arma::fvec, arma::fvec>
 MondrianNode::compute_left_right_statistics(
-                                            int& split_dim, float& split_loc, const arma::fvec& sample_x,
+                                            const int& split_dim, const float& split_loc, const arma::fvec& sample_x,
                                             arma::fvec min_cur_block, arma::fvec max_cur_block,
                                             bool left_split) {
     std::vector<arma::fvec> points;
@@ -666,6 +1054,7 @@ void MondrianNode::set_child_node(MondrianNode& child_node,
     }
     /* Current node has a child, therefore, it is not longer a leaf node */
     is_leaf_ = false;
+    account_stats();
 }
 
 /**
@@ -689,11 +1078,10 @@ arma::fvec MondrianNode::get_prior_mean(arma::fvec& pred_prob_par) {
     return base;
 }
 arma::fvec MondrianNode::get_prior_mean() {
-    arma::fvec base(*num_classes_,arma::fill::ones);
-    if (id_parent_node_ == NULL) {
-        base = base / *num_classes_;
-    } else {
-        base = id_parent_node_->pred_prob_;
+    /* Uniform distribution at the root */
+    arma::fvec base(1, arma::fill::ones);
+    if (id_parent_node_ != NULL) {
+        base = *id_parent_node_->pred_prob_;
     }
     return base;
 }
@@ -701,36 +1089,362 @@ arma::fvec MondrianNode::get_prior_mean() {
  * Compute posterior mean
  */
 arma::fvec MondrianNode::compute_posterior_mean_normalized_stable(
-                                                                  arma::Col<arma::uword>& cnt, float& discount,
-                                                                  arma::fvec& base) {
-    if (settings_->debug)
+                                                                  const LabelHistogram& cnt, const float& discount,
+                                                                  arma::fvec& base, bool tables) const {
+    if (debug_output(settings_->debug))
         cout << "compute_posterior....." << endl;
-    arma::fvec cnt_f = arma::conv_to<arma::fvec>::from(cnt);
-    arma::fvec ones_vec(cnt_f.size(),arma::fill::ones);
-    arma::fvec num_tables_k = arma::min(cnt_f, ones_vec);
-    float num_customers = float(arma::sum(cnt));
-    float num_tables = float(arma::sum(num_tables_k));
-    /* Calculate probability of each class */
-    arma::fvec pred_prob = (cnt_f - discount * num_tables_k +
-                            discount * num_tables * base) / num_customers;
+    float num_tables = float(cnt.num_entries());
+    /* Internal nodes: one customer per class seen ("tables") */
+    float num_customers = tables ? num_tables : float(cnt.total());
+    /* No data at the node yet -> prior mean */
+    if (num_customers <= 0)
+        return base;
+    /* Calculate probability of each class (prior part) */
+    int num_classes = *num_classes_;
+    float prior_weight = discount * num_tables / num_customers;
+    arma::uword num_base = min(arma::uword(num_classes), base.n_elem - 1);
+    arma::fvec pred_prob(num_classes + 1, arma::fill::zeros);
+    for (arma::uword k = 0; k < num_base; k++)
+        pred_prob[k] = prior_weight * base[k];
+    pred_prob[num_classes] = prior_weight * base[base.n_elem - 1];
+    /* Only classes with a count > 0 have customers and tables */
+    for (int i = 0; i < cnt.num_entries(); i++) {
+        int k = cnt.label(i);
+        if (k >= num_classes)
+            continue;
+        float cnt_k = tables ? 1.f : float(cnt.count_at(i));
+        pred_prob[k] += (cnt_k - discount) / num_customers;
+    }
     
     return pred_prob;
 }
 
-void MondrianNode::update_depth() {
-    depth_++;
-    if (id_left_child_node_ != NULL)
-        id_left_child_node_->update_depth();
-    if (id_right_child_node_ != NULL)
-        id_right_child_node_->update_depth();
+/*
+ * Recompute the posterior from the root down (the prior mean of every node
+ * on the path is the recomputed posterior of its parent)
+ */
+arma::fvec MondrianNode::recompute_posterior() const {
+    vector<const MondrianNode*> path;
+    for (const MondrianNode* node = this; node != NULL;
+         node = node->id_parent_node_)
+        path.push_back(node);
+    /* Uniform prior mean at the root */
+    arma::fvec posterior(1, arma::fill::ones);
+    for (int i = int(path.size()) - 1; i >= 0; i--) {
+        const MondrianNode* node = path[i];
+        float discount = exp(-settings_->discount_param *
+                             node->max_split_costs_);
+        arma::fvec base = posterior;
+        posterior = compute_posterior_mean_normalized_stable(
+            node->count_labels_, discount, base, !node->is_leaf_);
+    }
+    return posterior;
+}
+
+/*
+ * Compute depth of the node (number of parent nodes)
+ *
+ * The depth is not stored in the node: inserting a new parent node would
+ * change the depth of the whole subtree below it.
+ */
+int MondrianNode::get_depth() const {
+    int depth = 0;
+    for (const MondrianNode* node = id_parent_node_; node != NULL;
+         node = node->id_parent_node_) {
+        MF_COUNT(mondrian_tree_->counters_, num_depth_steps);
+        depth++;
+    }
+    return depth;
+}
+
+/*
+ * Add the depths of all leaves below the current node to "stats"
+ */
+void MondrianNode::collect_leaf_depths(mondrian_tree_stats& stats,
+                                       int depth) const {
+    vector<pair<const MondrianNode*, int> > node_stack;
+    node_stack.push_back(make_pair(this, depth));
+    while (!node_stack.empty()) {
+        const MondrianNode* node = node_stack.back().first;
+        int node_depth = node_stack.back().second;
+        node_stack.pop_back();
+        if (node->is_leaf_) {
+            stats.add_leaf_depth(node_depth);
+            continue;
+        }
+        if (node->id_right_child_node_ != NULL)
+            node_stack.push_back(make_pair(node->id_right_child_node_.load(),
+                                           node_depth + 1));
+        if (node->id_left_child_node_ != NULL)
+            node_stack.push_back(make_pair(node->id_left_child_node_.load(),
+                                           node_depth + 1));
+    }
+}
+
+/*
+ * Add internal nodes below the current node whose children are both leaves
+ */
+void MondrianNode::collect_twigs(vector<MondrianNode*>& twigs) const {
+    if (is_leaf_)
+        return;
+    vector<MondrianNode*> node_stack;
+    node_stack.push_back(id_left_child_node_);
+    node_stack.push_back(id_right_child_node_);
+    while (!node_stack.empty()) {
+        MondrianNode* node = node_stack.back();
+        node_stack.pop_back();
+        if (node->is_leaf_)
+            continue;
+        MondrianNode* left = node->id_left_child_node_;
+        MondrianNode* right = node->id_right_child_node_;
+        if (left->is_leaf_ && right->is_leaf_) {
+            twigs.push_back(node);
+        } else {
+            node_stack.push_back(right);
+            node_stack.push_back(left);
+        }
+    }
+}
+
+/*
+ * Turn the current node into a leaf (memory governor)
+ *
+ * Internal nodes count every sample that passes them, so the histogram of
+ * the node already contains the samples of both children and is kept as it
+ * is (adding the counts of the children would count them twice).
+ */
+void MondrianNode::collapse() {
+    MondrianNode* left = id_left_child_node_;
+    MondrianNode* right = id_right_child_node_;
+    assert(!is_leaf_ && left->is_leaf_ && right->is_leaf_);
+    decay_counts();
+    /* Like an unsplit leaf, the node lives until the end of its budget */
+    max_split_costs_ = budget_;
+    /* Readers stop at this node from now on */
+    is_leaf_ = true;
+    id_left_child_node_ = NULL;
+    id_right_child_node_ = NULL;
+    if (mondrian_tree_->get_max_prob_mass_leaf() == left ||
+        mondrian_tree_->get_max_prob_mass_leaf() == right ||
+        expected_prob_mass_ >
+        mondrian_tree_->get_max_prob_mass_leaf()->expected_prob_mass_)
+        mondrian_tree_->set_max_prob_mass_leaf(*this);
+    /* Concurrent readers may still visit the children */
+    left->account_stats(true);
+    right->account_stats(true);
+    epoch_manager.retire(left);
+    epoch_manager.retire(right);
+    /* Posterior of a leaf (all counts instead of one per class) */
+    account_stats();
+    update_posterior();
+}
+
+/*
+ * Add internal nodes with a forgotten leaf as child
+ */
+void MondrianNode::collect_forgotten_parents(vector<MondrianNode*>& nodes) {
+    vector<MondrianNode*> node_stack;
+    if (!is_leaf_)
+        node_stack.push_back(this);
+    while (!node_stack.empty()) {
+        MondrianNode* node = node_stack.back();
+        node_stack.pop_back();
+        MondrianNode* left = node->id_left_child_node_;
+        MondrianNode* right = node->id_right_child_node_;
+        if (left->is_forgotten() || right->is_forgotten())
+            nodes.push_back(node);
+        if (!right->is_leaf_)
+            node_stack.push_back(right);
+        if (!left->is_leaf_)
+            node_stack.push_back(left);
+    }
+}
+
+/*
+ * Leaf whose counts are zero after the halvings that are due
+ */
+bool MondrianNode::is_forgotten() const {
+    if (!is_leaf_)
+        return false;
+    unsigned long num_halvings = mondrian_tree_->get_decay_epoch() -
+    decay_epoch_;
+    return num_halvings >= 32 || (count_labels_.total() >> num_halvings) == 0;
+}
+
+/*
+ * Remove the current node and its forgotten leaf "child"
+ *
+ * The sibling of "child" takes the place of the current node: it starts
+ * at the split time of the current node (budget and split cost of the
+ * removed split are added to the sibling).
+ */
+MondrianNode* MondrianNode::remove_child(MondrianNode& child) {
+    MondrianNode* sibling = (id_left_child_node_ == &child) ?
+    id_right_child_node_ : id_left_child_node_;
+    assert(child.is_leaf_ && sibling != NULL);
+    sibling->decay_counts();
+    sibling->budget_ = budget_;
+    sibling->max_split_costs_ += max_split_costs_;
+    /* Concurrent readers see either the current node or the sibling */
+    MondrianNode* parent = id_parent_node_;
+    if (parent != NULL)
+        parent->set_child_node(*sibling,
+                               parent->id_left_child_node_ == this);
+    sibling->id_parent_node_ = parent;
+    if (mondrian_tree_->get_max_prob_mass_leaf() == &child ||
+        mondrian_tree_->get_max_prob_mass_leaf() == this)
+        mondrian_tree_->set_max_prob_mass_leaf(*sibling);
+    /* Detach the sibling, so the destructor does not delete it */
+    id_left_child_node_ = NULL;
+    id_right_child_node_ = NULL;
+    child.account_stats(true);
+    account_stats(true);
+    epoch_manager.retire(&child);
+    epoch_manager.retire(this);
+    return sibling;
+}
+
+/*
+ * Apply the halvings of the counts that are due (forgetting)
+ */
+void MondrianNode::decay_counts() {
+    unsigned long epoch = mondrian_tree_->get_decay_epoch();
+    if (epoch == decay_epoch_)
+        return;
+    unsigned long num_halvings = epoch - decay_epoch_;
+    decay_epoch_ = epoch;
+    if (num_halvings >= 32) {
+        count_labels_.clear();
+        data_counter_ = 0;
+    } else {
+        count_labels_.halve(int(num_halvings));
+        data_counter_ = floor(ldexp(data_counter_, -int(num_halvings)));
+    }
+    account_stats();
 }
+
+/*
+ * Check invariants of the current node and all nodes below
+ */
+int MondrianNode::validate_subtree(long& num_nodes, long& num_leaves) const {
+    int num_violations = 0;
+    vector<const MondrianNode*> node_stack(1, this);
+    while (!node_stack.empty()) {
+        const MondrianNode* node = node_stack.back();
+        node_stack.pop_back();
+        num_nodes++;
+        num_violations += node->validate_node();
+        if (node->is_leaf_) {
+            num_leaves++;
+        } else {
+            if (node->id_right_child_node_ != NULL)
+                node_stack.push_back(node->id_right_child_node_);
+            if (node->id_left_child_node_ != NULL)
+                node_stack.push_back(node->id_left_child_node_);
+        }
+    }
+    return num_violations;
+}
+
+/*
+ * Check invariants of the current node and print every violation
+ */
+int MondrianNode::validate_node() const {
+    int num_violations = 0;
+    int feature_dim = mondrian_block_->get_feature_dim();
+    arma::fvec min_block = mondrian_block_->get_min_block_dim();
+    arma::fvec max_block = mondrian_block_->get_max_block_dim();
+    /* 1. Block bounds (an empty block has bounds [inf, -inf]) */
+    bool empty_block = min_block[0] == numeric_limits<float>::infinity();
+    if (!empty_block && !all(max_block >= min_block)) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": lower block boundary exceeds upper boundary" << endl;
+        num_violations++;
+    }
+    /* 2. Block lies inside the block of the parent */
+    if (id_parent_node_ != NULL && !empty_block) {
+        arma::fvec parent_min = id_parent_node_->mondrian_block_->get_min_block_dim();
+        arma::fvec parent_max = id_parent_node_->mondrian_block_->get_max_block_dim();
+        if (!all(min_block >= parent_min) || !all(max_block <= parent_max)) {
+            cout << "[ERROR] - validate_node " << this <<
+            ": block is not inside the block of the parent" << endl;
+            num_violations++;
+        }
+    }
+    if (max_split_costs_ < 0) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": negative split cost " << max_split_costs_ << endl;
+        num_violations++;
+    }
+    /* 3. Cached posterior is up to date and does not contain NaN */
+    if (!all(*pred_prob_ == *pred_prob_)) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": posterior contains NaN" << endl;
+        num_violations++;
+    }
+    if (posterior_dirty_) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": posterior was not computed" << endl;
+        num_violations++;
+    }
+#ifdef STREAM_BASED_AL_CHECKED
+    /* Cached posterior equals a fresh top-down recomputation */
+    if (!posterior_dirty_) {
+        arma::fvec posterior(*num_classes_, arma::fill::zeros);
+        add_posterior(recompute_posterior(), 1.f, posterior);
+        arma::fvec cached(*num_classes_, arma::fill::zeros);
+        add_posterior(*pred_prob_, 1.f, cached);
+        bool equal = true;
+        for (arma::uword i = 0; equal && i < cached.n_elem; i++)
+            equal = fabs(posterior[i] - cached[i]) <= 1e-5f;
+        if (!equal) {
+            cout << "[ERROR] - validate_node " << this <<
+            ": cached posterior differs from the recomputed posterior" <<
+            endl;
+            num_violations++;
+        }
+    }
+#endif
+    if (is_leaf_)
+        return num_violations;
+    /* 4. Split and links to children */
+    if (id_left_child_node_ == NULL || id_right_child_node_ == NULL ||
+        id_left_child_node_->id_parent_node_ != this ||
+        id_right_child_node_->id_parent_node_ != this) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": inconsistent links to children" << endl;
+        return num_violations + 1;
+    }
+    if (split_dim_ < 0 || split_dim_ >= feature_dim) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": invalid split dimension " << split_dim_ << endl;
+        return num_violations + 1;
+    }
+    if (split_loc_ < min_block[split_dim_] ||
+        split_loc_ > max_block[split_dim_]) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": split location " << split_loc_ << " outside of block" << endl;
+        num_violations++;
+    }
+    /* 5. Decision distribution */
+    if (!(decision_distr_param_alpha_ > 0 &&
+          decision_distr_param_alpha_ < INFINITY &&
+          decision_distr_param_beta_ > 0 &&
+          decision_distr_param_beta_ < INFINITY)) {
+        cout << "[ERROR] - validate_node " << this <<
+        ": invalid decision distribution parameters" << endl;
+        num_violations++;
+    }
+    return num_violations;
+}
+
 /*
  * Update split cost, split dimension, split location
  */
 void MondrianNode::sample_mondrian_block(const Sample& sample,
                                          bool create_new_leaf) {
     
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### sample_mondrian_block-----------------" << endl;
     
     // Compute dimension-wise minimum and maximum of the block and the new sample
@@ -766,7 +1480,7 @@ void MondrianNode::sample_mondrian_block(const Sample& sample,
     
     if (budget_ > split_cost) {
         assert(is_leaf_);
-        is_leaf_ = false;  /* Will now be a parent node */
+        MF_COUNT(mondrian_tree_->counters_, num_splits);
         int feature_dim = mondrian_block_->get_feature_dim();
         
         /* Sample split dimension */
@@ -780,7 +1494,7 @@ void MondrianNode::sample_mondrian_block(const Sample& sample,
         /* Set decision prior parameters for density estimation */
         set_decision_distr_params(min_block_sample, max_block_sample);
         
-        if (settings_->debug) {
+        if (debug_output(settings_->debug)) {
             cout << "min_block: " << min_block << endl;
             cout << "max_block: " << max_block << endl;
             cout << "split_dim: " << split_dim_ << endl;
@@ -794,12 +1508,11 @@ void MondrianNode::sample_mondrian_block(const Sample& sample,
                                                          split_loc_, sample.x,
                                                          mondrian_block_->get_min_block_dim(),
                                                          mondrian_block_->get_max_block_dim(), true);
-        int tmp_depth = depth_+1;
         MondrianNode* left_child_node = new MondrianNode(
                                                          *mondrian_tree_, num_classes_,
                                                          feature_dim, new_budget, (*this),
                                                          left_right_block.first, left_right_block.second,
-                                                         *settings_, tmp_depth);
+                                                         *settings_);
         /* Right side of the split */
         left_right_block = compute_left_right_statistics(split_dim_,
                                                          split_loc_, sample.x,
@@ -809,7 +1522,7 @@ void MondrianNode::sample_mondrian_block(const Sample& sample,
                                                           *mondrian_tree_, num_classes_,
                                                           feature_dim, new_budget, (*this),
                                                           left_right_block.first, left_right_block.second,
-                                                          *settings_, tmp_depth);
+                                                          *settings_);
         id_left_child_node_ = left_child_node;
         id_right_child_node_ = right_child_node;
         
@@ -840,17 +1553,45 @@ void MondrianNode::sample_mondrian_block(const Sample& sample,
             id_left_child_node_->sample_mondrian_block(sample, true);
             id_left_child_node_->add_training_point_to_node(sample);
         }
-        
+        /*
+         * Now a parent node: the child nodes are complete, so concurrent
+         * readers may follow them
+         */
+        is_leaf_ = false;
+        account_stats();
     } else {
+        /*
+         * The split time exceeds the lifetime: the leaf lives until the
+         * end of its budget (a later parent insertion cannot take more
+         * than the remaining budget)
+         */
+        max_split_costs_ = budget_;
         is_leaf_ = true;
+        account_stats();
     }
 }
 
 /*
  * Extend mondrian block to include new training data
+ *
+ * Walks down the path of the sample (iteratively) until the sample is
+ * added to a leaf or a new node is inserted.
  */
 void MondrianNode::extend_mondrian_block(const Sample& sample) {
-    if (settings_->debug)
+    MondrianNode* node = this;
+    while (node != NULL) {
+        node = node->extend_mondrian_block_node(sample);
+    }
+}
+
+/*
+ * Extend mondrian block of current node and return the child node the
+ * sample has to be passed to (NULL if the update is finished)
+ */
+MondrianNode* MondrianNode::extend_mondrian_block_node(const Sample& sample) {
+    MF_COUNT(mondrian_tree_->counters_, num_update_visits);
+    decay_counts();
+    if (debug_output(settings_->debug))
         cout << "### extend_mondrian_block: " << endl;
     
     float split_cost = 0.; /* On split_cost depends
@@ -860,19 +1601,11 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
      *  - e_lower = max(l^x_j - x,0)
      *  - e_upper = min(x - u^x_j,0)
      */
-    arma::fvec zero_vec(mondrian_block_->get_feature_dim(), arma::fill::zeros);
-    arma::fvec tmp_min_block = mondrian_block_->get_min_block_dim();
-    arma::fvec tmp_max_block = mondrian_block_->get_max_block_dim();
-    
-    arma::fvec e_lower = arma::max(
-                                   zero_vec, (tmp_min_block - sample.x));
-    arma::fvec e_upper = arma::max(
-                                   zero_vec, (sample.x - tmp_max_block));
     /*
      * sample e (expo_param) from exponential distribution with rate
      * sum_d( e^l_d + e^u_d )
      */
-    float expo_param = arma::sum(e_lower) + arma::sum(e_upper);
+    float expo_param = mondrian_block_->get_outside_sum(sample.x);
     
     /* Exponential distribution */
     assert(!(split_cost < 0));
@@ -883,10 +1616,12 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
         split_cost = rng.rand_exp_distribution(expo_param);
     }
     
-    /* Check if all labels are identical */
-    if (pause_mondrian()) {
+    /*
+     * Check if all labels are identical (only leaves are paused, internal
+     * nodes may lose labels by forgetting)
+     */
+    if (is_leaf_ && pause_mondrian()) {
         /* Try to extend a paused Mondrian (labels are not identical) */
-        assert(is_leaf_);
         split_cost = numeric_limits<float>::infinity();
     }
     
@@ -913,14 +1648,14 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
                 assert(id_left_child_node_!=NULL);
                 // Update density parameters
                 increment_decision_distr_params(left_split);
-                // Recurse on child
-                id_left_child_node_->extend_mondrian_block(sample);
+                // Continue with child
+                return id_left_child_node_;
             } else {
                 assert(id_right_child_node_!=NULL);
                 // Update density parameters
                 increment_decision_distr_params(!left_split);
-                // Recurse on child
-                id_right_child_node_->extend_mondrian_block(sample);
+                // Continue with child
+                return id_right_child_node_;
             }
         } else {
             assert(is_leaf_);
@@ -936,6 +1671,7 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
         /* (2) Current budget is enough, i.e.
          - point lies outside block B^x_j and exponential
          draw + old budget does NOT exceed budget */
+        MF_COUNT(mondrian_tree_->counters_, num_parent_insertions);
         /* Initialize new parent node */
         int feature_dim = mondrian_block_->get_feature_dim();
         arma::fvec min_block = arma::min(mondrian_block_->get_min_block_dim(),
@@ -945,7 +1681,7 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
         MondrianNode* new_parent_node = new MondrianNode(
                                                          *mondrian_tree_, num_classes_,
                                                          feature_dim, budget_, *id_parent_node_,
-                                                         min_block, max_block, *settings_, depth_);
+                                                         min_block, max_block, *settings_);
         /* Set "new_parent_node" as new parent of current node */
         /* Pass histogram of current node to new parent node */
         new_parent_node->init_update_posterior_node_incremental(this, sample);
@@ -953,6 +1689,11 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
          * Sample split dimension \delta, choosing d with probability
          * proportional to e^l_d + d^u_d
          */
+        arma::fvec zero_vec(feature_dim, arma::fill::zeros);
+        arma::fvec e_lower = arma::max(
+                                       zero_vec, (mondrian_block_->get_min_block_dim() - sample.x));
+        arma::fvec e_upper = arma::max(
+                                       zero_vec, (sample.x - mondrian_block_->get_max_block_dim()));
         arma::fvec feat_score = e_lower + e_upper;
         /* Problem can occur that min and max boundary value are the same
          * at a sampled split location -> solution: sample again until
@@ -998,25 +1739,14 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
             new_child_block = min_block;
         }
         /* Grow Mondrian child node of the "outer Mondrian" */
-        int new_depth = depth_ + 1;
         MondrianNode* child_node = new MondrianNode(
                                                     *mondrian_tree_, num_classes_,
                                                     feature_dim, new_budget, *new_parent_node,
-                                                    new_child_block, new_child_block, *settings_, new_depth);
+                                                    new_child_block, new_child_block, *settings_);
         /* Set child nodes of newly created parent node ("new_parent_node") */
         new_parent_node->set_child_node(*child_node, (!is_left_node));
         new_parent_node->set_child_node(*this, is_left_node);
         new_parent_node->is_leaf_ = false;
-        /* Set "new_parent_node" as new child node of current parent node */
-        if (id_parent_node_ != NULL ) { /* root node */
-            if (id_parent_node_->id_left_child_node_ == this) {
-                id_parent_node_->set_child_node(*new_parent_node, true);
-            } else {
-                id_parent_node_->set_child_node(*new_parent_node, false);
-            }
-        }
-        /* Set "new_parent_node" as new parent of current node */
-        id_parent_node_ = new_parent_node;
         /*
          * Initialize posterior of new created child node
          * (initialize histogram with zeros -> pointer = NULL)
@@ -1032,11 +1762,25 @@ void MondrianNode::extend_mondrian_block(const Sample& sample) {
         new_parent_node->split_loc_ = split_loc;
         new_parent_node->split_dim_ = split_dim;
         max_split_costs_ -= split_cost;
-        update_depth();
         
         /* Set decision prior parameters for density estimation */
         new_parent_node->set_decision_distr_params(min_block, max_block);
+        /*
+         * Set "new_parent_node" as new child node of current parent node.
+         * The new nodes are complete at this point, concurrent readers
+         * see either the old or the new subtree.
+         */
+        if (id_parent_node_ != NULL ) { /* root node */
+            if (id_parent_node_->id_left_child_node_ == this) {
+                id_parent_node_->set_child_node(*new_parent_node, true);
+            } else {
+                id_parent_node_->set_child_node(*new_parent_node, false);
+            }
+        }
+        /* Set "new_parent_node" as new parent of current node */
+        id_parent_node_ = new_parent_node;
     }
+    return NULL;
 }
 
 /**
@@ -1061,18 +1805,19 @@ void MondrianNode::set_decision_distr_params(arma::fvec& min_block, arma::fvec&
     // Compute linear volume of right half of parent mondrian block
     arma::fvec split_vec_tmp = min_block;
     split_vec_tmp[split_dim_] = split_loc_;
-    assert(all(max_block >= split_vec_tmp));
+    MF_CHECK(all(max_block >= split_vec_tmp));
     float volume_right = sum(max_block - split_vec_tmp);
     // Compute linear volume of left half of parent mondrian block
     split_vec_tmp = max_block;
     split_vec_tmp[split_dim_] = split_loc_;
-    assert(all(split_vec_tmp >= min_block));
+    MF_CHECK(all(split_vec_tmp >= min_block));
     float volume_left = sum(split_vec_tmp - min_block);
     
     // Set the prior parameters based on the Mondrian block dimensions of the parent node
-    decision_distr_param_beta_ = settings_->decision_prior_hyperparam * pow(depth_+1,2) *
+    int depth = get_depth();
+    decision_distr_param_beta_ = settings_->decision_prior_hyperparam * pow(depth+1,2) *
     volume_left/(volume_right + volume_left);
-    decision_distr_param_alpha_ = settings_->decision_prior_hyperparam * pow(depth_+1,2) *
+    decision_distr_param_alpha_ = settings_->decision_prior_hyperparam * pow(depth+1,2) *
     volume_right/(volume_right + volume_left);
     assert(decision_distr_param_alpha_ > 0 && decision_distr_param_alpha_ < INFINITY);
     assert(decision_distr_param_beta_ > 0 && decision_distr_param_beta_ < INFINITY);
@@ -1083,30 +1828,45 @@ void MondrianNode::set_decision_distr_params(arma::fvec& min_block, arma::fvec&
  * children based on the parameters of the decision distributions.
  */
 void MondrianNode::update_expected_prob_mass(){
+    /* Reusable stack of the tree for the (pre-order) traversal */
+    vector<MondrianNode*>& node_stack = mondrian_tree_->node_stack_;
+    node_stack.clear();
     if (id_parent_node_ == NULL){
+        MF_COUNT(mondrian_tree_->counters_, num_update_prob_mass);
         expected_prob_mass_ = 1;
         if(is_leaf_){
             mondrian_tree_->set_max_prob_mass_leaf(*this);
         }
         
-        // Recurse on children
-        if(id_left_child_node_ != NULL){
-            id_left_child_node_->update_expected_prob_mass(true);
-        }
+        // Continue with children (left child first)
         if(id_right_child_node_ != NULL){
-            id_right_child_node_->update_expected_prob_mass(false);
+            node_stack.push_back(id_right_child_node_);
+        }
+        if(id_left_child_node_ != NULL){
+            node_stack.push_back(id_left_child_node_);
         }
     }else{
+        node_stack.push_back(this);
+    }
+    while (!node_stack.empty()) {
+        MondrianNode* node = node_stack.back();
+        node_stack.pop_back();
         // Update based on whether this node is a left or right child node
-        if(id_parent_node_->id_left_child_node_ == this){
-            update_expected_prob_mass(true);
-        }else{
-            update_expected_prob_mass(false);
+        node->update_expected_prob_mass(
+            node->id_parent_node_->id_left_child_node_ == node);
+        if (!node->is_leaf_) {
+            node_stack.push_back(node->id_right_child_node_);
+            node_stack.push_back(node->id_left_child_node_);
         }
     }
 }
 
+/*
+ * Update expected probability mass of the current node only (based on
+ * the mass of its parent)
+ */
 void MondrianNode::update_expected_prob_mass(bool is_left){
+    MF_COUNT(mondrian_tree_->counters_, num_update_prob_mass);
     float alpha = id_parent_node_->decision_distr_param_alpha_;
     float beta = id_parent_node_->decision_distr_param_beta_;
     // Update based on whether this node is a left or right child node
@@ -1121,11 +1881,6 @@ void MondrianNode::update_expected_prob_mass(bool is_left){
            || !mondrian_tree_->get_max_prob_mass_leaf()->is_leaf_){
             mondrian_tree_->set_max_prob_mass_leaf(*this);
         }
-        return;
-    }else{
-        // Recurse on children
-        id_left_child_node_->update_expected_prob_mass(true);
-        id_right_child_node_->update_expected_prob_mass(false);
     }
 }
 
@@ -1152,17 +1907,22 @@ std::ostream & operator<<(std::ostream &os, const MondrianNode &mn) {
 MondrianTree::MondrianTree(const mondrian_settings& settings,
                            const int& feature_dim) :
 num_classes_(0),
-settings_(&settings) {
+data_counter_(0),
+settings_(&settings),
+feature_dim_(feature_dim),
+decay_epoch_(0),
+num_samples_(0) {
     if (settings.debug)
         cout << "### Init Mondrian Tree " << endl;
     /* Root node has no parent node -> set NULL pointer */
     MondrianNode* null_parent_node = NULL;
-    int depth = 0;
     /* Initialize root node */
     root_node_ = new MondrianNode(
                                   *this, &num_classes_, feature_dim,
-                                  std::numeric_limits<float>::infinity(),
-                                  *null_parent_node, settings, depth);
+                                  settings.init_budget,
+                                  *null_parent_node, settings);
+    /* Uniform posterior until the first sample arrives */
+    root_node_->update_posterior();
     /* Initialize pointer to node with maximum probability mass */
     max_prob_mass_leaf_ = root_node_;
 }
@@ -1180,6 +1940,7 @@ void MondrianTree::print_info() {
     cout << "Properties of current tree: " << endl;
     cout << "Number of classes: " << num_classes_ << endl;
     cout << "Data points:       " << data_counter_ << endl;
+    get_stats().print(cout);
     cout << endl;
     root_node_->print_info();
 }
@@ -1188,18 +1949,53 @@ void MondrianTree::print_info() {
  * Update current data point
  */
 void MondrianTree::update(Sample& sample) {
+    /* Without other readers, posteriors and boundaries change in place */
+    epoch_manager.begin_update();
     /* Check if sample belongs to a new class */
     bool new_class = check_if_new_class(sample);
     if (new_class){
         update_class_numbers(sample);
     }
     ++data_counter_;  /* Update counter of data points */
+    ++num_samples_;
+    MF_COUNT(counters_, num_updates);
     /* Start updating current sample at the root node of the tree */
+    MF_TIMER_START(time_extend);
     root_node_->update(sample);
+    MF_TIMER_STOP(counters_, time_extend, time_extend);
     /* Check if there exists a new root node */
+    MF_TIMER_START(time_root_update);
     root_node_ = root_node_->update_root_node();
+    MF_TIMER_STOP(counters_, time_root_update, time_root_update);
+    /* Update cached posteriors */
+    MF_TIMER_START(time_posterior);
+    update_posteriors(sample);
+    MF_TIMER_STOP(counters_, time_posterior, time_posterior);
+    /* Forgetting: halve the counts every half-life (lazily, per node) */
+    if (settings_->forget_half_life > 0) {
+        unsigned long decay_epoch = (unsigned long)(num_samples_ /
+        uint64_t(settings_->forget_half_life));
+        if (decay_epoch != decay_epoch_) {
+            decay_epoch_ = decay_epoch;
+            prune_forgotten();
+        }
+    }
     /* Update expected probability masses */
+    MF_TIMER_START(time_prob_mass);
     root_node_->update_expected_prob_mass();
+    MF_TIMER_STOP(counters_, time_prob_mass, time_prob_mass);
+    /* Free replaced posteriors and boundaries no reader can reach */
+    epoch_manager.collect();
+    epoch_manager.end_update();
+}
+
+void MondrianTree::add_classes(int num_classes) {
+    /*
+     * The cached posteriors stay valid: their uniform part is spread over
+     * the new number of classes when they are read
+     */
+    if (num_classes > num_classes_)
+        num_classes_ = num_classes;
 }
 /*
  * Predict class of current sample
@@ -1208,10 +2004,15 @@ int MondrianTree::classify(Sample& sample, arma::fvec& pred_prob,
                                 mondrian_confidence& m_conf) {
     
     float prob_not_separated_yet = 1.;
+    MF_COUNT(counters_, num_classifications);
+    MF_TIMER_START(time_classify);
     //arma::fvec pred_prob(num_classes_, arma::fill::zeros);
+    /* Nodes of a concurrent update are not freed while the guard exists */
+    EpochGuard guard;
     int pred_class = root_node_->classify(sample, pred_prob,
                                                prob_not_separated_yet, m_conf);
-    if (settings_->debug) {
+    MF_TIMER_STOP(counters_, time_classify, time_classify);
+    if (debug_output(settings_->debug)) {
         cout << "pred class: " << pred_class << endl;
         cout << "prob: " << endl << pred_prob << endl;
     }
@@ -1221,22 +2022,18 @@ int MondrianTree::classify(Sample& sample, arma::fvec& pred_prob,
 /*
  * Update number of classes
  *  - Increase variable num_classes_ +1
- *  - Update histograms all nodes
+ *  - Histograms of the nodes grow lazily when they see the new class
  */
 void MondrianTree::update_class_numbers(Sample& sample) {
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "### update_class_numbers" << endl;
     /* +1 only works if first label = 0 */
-    if (settings_->debug)
+    if (debug_output(settings_->debug))
         cout << "num_classes: " << num_classes_ << endl;
     for (int i_new = num_classes_; i_new <= sample.y; i_new++) {
         ++num_classes_;  /* Increase number of classes */
+        MF_COUNT(counters_, num_new_classes);
     }
-    /*
-     * Update histogram of root node
-     * -> will update all nodes of the tree
-     */
-    root_node_->add_new_class();
 }
 
 /*
@@ -1257,6 +2054,233 @@ bool MondrianTree::check_if_new_class(Sample& sample) {
     return new_class;
 }
 
+/*
+ * Return size and memory statistics of the tree
+ */
+mondrian_tree_stats MondrianTree::get_stats() const {
+    mondrian_tree_stats stats = stats_;
+    root_node_->collect_leaf_depths(stats, 0);
+    return stats;
+}
+
+void MondrianTree::collect_twigs(vector<mondrian_twig>& twigs) {
+    vector<MondrianNode*> nodes;
+    root_node_->collect_twigs(nodes);
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        mondrian_twig twig = {nodes[i]->get_expected_prob_mass(), this,
+            nodes[i]};
+        twigs.push_back(twig);
+    }
+}
+
+long MondrianTree::collapse(MondrianNode& twig) {
+    long bytes_before = stats_.total_bytes();
+    twig.collapse();
+    long bytes_released = bytes_before - stats_.total_bytes();
+    stats_.num_collapsed++;
+    stats_.bytes_collapsed += bytes_released;
+    return bytes_released;
+}
+
+int MondrianTree::validate_tree() const {
+    long num_nodes = 0;
+    long num_leaves = 0;
+    int num_violations = root_node_->validate_subtree(num_nodes, num_leaves);
+    if (root_node_->update_root_node() != root_node_) {
+        cout << "[ERROR] - validate_tree: root node has a parent" << endl;
+        num_violations++;
+    }
+    if (num_nodes != stats_.num_nodes || num_leaves != stats_.num_leaves) {
+        cout << "[ERROR] - validate_tree: statistics count " <<
+        stats_.num_nodes << " nodes/" << stats_.num_leaves <<
+        " leaves, tree has " << num_nodes << "/" << num_leaves << endl;
+        num_violations++;
+    }
+    if (max_prob_mass_leaf_ == NULL || !max_prob_mass_leaf_->is_leaf()) {
+        cout << "[ERROR] - validate_tree: leaf with maximum probability "
+        "mass is not a leaf" << endl;
+        num_violations++;
+    }
+    return num_violations;
+}
+
+void MondrianTree::update_posteriors(const Sample& sample) {
+    /* Subtrees whose prior mean changed */
+    node_stack_.clear();
+    /* 1. Nodes on the path of the sample (histograms changed) */
+    MondrianNode* node = root_node_;
+    while (node != NULL) {
+        bool changed = node->update_posterior();
+        if (node->is_leaf())
+            break;
+        MondrianNode* next = node->get_child_node(sample.x);
+        MondrianNode* other = (next == node->get_left_child_node()) ?
+        node->get_right_child_node() : node->get_left_child_node();
+        if (changed || other->posterior_dirty())
+            node_stack_.push_back(other);
+        node = next;
+    }
+    /* 2. Subtrees next to the path */
+    update_pending_posteriors();
+}
+
+void MondrianTree::update_pending_posteriors() {
+    MondrianNode* node = NULL;
+    while (!node_stack_.empty()) {
+        node = node_stack_.back();
+        node_stack_.pop_back();
+        bool changed = node->update_posterior();
+        if (node->is_leaf())
+            continue;
+        if (changed || node->get_left_child_node()->posterior_dirty())
+            node_stack_.push_back(node->get_left_child_node());
+        if (changed || node->get_right_child_node()->posterior_dirty())
+            node_stack_.push_back(node->get_right_child_node());
+    }
+}
+
+void MondrianTree::prune_forgotten() {
+    vector<MondrianNode*> nodes;
+    /* Collapsed nodes may be forgotten leaves of the next round */
+    while (true) {
+        nodes.clear();
+        root_node_->collect_forgotten_parents(nodes);
+        if (nodes.empty())
+            break;
+        for (unsigned int i = 0; i < nodes.size(); i++) {
+            MondrianNode* node = nodes[i];
+            MondrianNode* left = node->get_left_child_node();
+            MondrianNode* right = node->get_right_child_node();
+            if (left->is_forgotten() && right->is_forgotten()) {
+                node->collapse();
+                stats_.num_forgotten += 2;
+                continue;
+            }
+            bool is_root = (node == root_node_);
+            MondrianNode* sibling = node->remove_child(
+                left->is_forgotten() ? *left : *right);
+            if (is_root)
+                root_node_ = sibling;
+            stats_.num_forgotten += 2;
+            /* Prior mean of the sibling changed */
+            node_stack_.clear();
+            node_stack_.push_back(sibling);
+            update_pending_posteriors();
+        }
+    }
+}
+
+/*
+ * Write the tree to a snapshot: header, nodes in preorder (left subtree
+ * before right subtree) and the preorder index of the leaf with the
+ * maximum probability mass
+ */
+void MondrianTree::save(ostream& os) const {
+    write_binary(os, int32_t(num_classes_));
+    write_binary(os, data_counter_);
+    write_binary(os, uint64_t(decay_epoch_));
+    write_binary(os, num_samples_);
+    write_binary(os, int64_t(stats_.num_nodes));
+    int64_t max_prob_mass_index = -1, first_leaf_index = -1, index = 0;
+    vector<const MondrianNode*> node_stack(1, root_node_.load());
+    while (!node_stack.empty()) {
+        const MondrianNode* node = node_stack.back();
+        node_stack.pop_back();
+        if (node == max_prob_mass_leaf_)
+            max_prob_mass_index = index;
+        if (node->is_leaf() && first_leaf_index < 0)
+            first_leaf_index = index;
+        node->save(os);
+        index++;
+        if (!node->is_leaf()) {
+            node_stack.push_back(node->get_right_child_node());
+            node_stack.push_back(node->get_left_child_node());
+        }
+    }
+    write_binary(os, max_prob_mass_index >= 0 ? max_prob_mass_index :
+                 first_leaf_index);
+}
+
+/*
+ * Replace the tree by a snapshot
+ */
+bool MondrianTree::load(istream& is, uint32_t version) {
+    int32_t num_classes = 0;
+    uint64_t decay_epoch = 0;
+    int64_t num_nodes = 0;
+    bool valid = read_binary(is, num_classes) &&
+    read_binary(is, data_counter_) && read_binary(is, decay_epoch);
+    /* Older snapshots only have the float counter */
+    num_samples_ = uint64_t(data_counter_);
+    valid = valid && (version < 3 || read_binary(is, num_samples_)) &&
+    read_binary(is, num_nodes) && num_classes >= 0 && num_nodes > 0;
+    /* Start from an empty tree */
+    delete root_node_;
+    root_node_ = NULL;
+    max_prob_mass_leaf_ = NULL;
+    num_classes_ = valid ? num_classes : 0;
+    decay_epoch_ = decay_epoch;
+    MondrianNode* null_parent_node = NULL;
+    /*
+     * Slots (parent, left or right) waiting for the next node of the
+     * preorder: the left slot is on top, so the left subtree is read first
+     */
+    vector<pair<MondrianNode*, bool> > slots;
+    vector<MondrianNode*> nodes;
+    slots.push_back(make_pair(null_parent_node, true));
+    while (valid && !slots.empty()) {
+        if (int64_t(nodes.size()) >= num_nodes) {
+            valid = false;
+            break;
+        }
+        MondrianNode* parent = slots.back().first;
+        bool is_left = slots.back().second;
+        slots.pop_back();
+        MondrianNode* node = new MondrianNode(
+                                              *this, &num_classes_, feature_dim_,
+                                              *parent, *settings_, is, valid);
+        if (parent == NULL)
+            root_node_ = node;
+        else
+            parent->link_child_node(*node, is_left);
+        nodes.push_back(node);
+        if (valid && !node->is_leaf()) {
+            slots.push_back(make_pair(node, false));
+            slots.push_back(make_pair(node, true));
+        }
+    }
+    int64_t max_prob_mass_index = -1;
+    valid = valid && int64_t(nodes.size()) == num_nodes &&
+    read_binary(is, max_prob_mass_index) && max_prob_mass_index >= 0 &&
+    max_prob_mass_index < num_nodes &&
+    nodes[max_prob_mass_index]->is_leaf();
+    if (!valid) {
+        /* Missing child nodes of a partial tree are NULL */
+        delete root_node_;
+        /* Empty tree as after construction */
+        num_classes_ = 0;
+        data_counter_ = 0;
+        decay_epoch_ = 0;
+        num_samples_ = 0;
+        root_node_ = new MondrianNode(
+                                      *this, &num_classes_, feature_dim_,
+                                      settings_->init_budget,
+                                      *null_parent_node, *settings_);
+        root_node_->update_posterior();
+        max_prob_mass_leaf_ = root_node_;
+        return false;
+    }
+    max_prob_mass_leaf_ = nodes[max_prob_mass_index];
+    /* Recompute the cached posteriors from the root down */
+    epoch_manager.begin_update();
+    node_stack_.clear();
+    node_stack_.push_back(root_node_);
+    update_pending_posteriors();
+    epoch_manager.collect();
+    epoch_manager.end_update();
+    return true;
+}
+
 MondrianNode* MondrianTree::get_max_prob_mass_leaf(){
     return max_prob_mass_leaf_;
 }
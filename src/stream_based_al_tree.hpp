@@ -9,8 +9,7 @@
 #ifndef stream_based_al_tree_hpp
 #define stream_based_al_tree_hpp
 
-/* Evaluate assertion */
-//#define NDEBUG /* Comment out if no assertion is needed */
+/* Evaluate assertion (compiled out by "make release", -DNDEBUG) */
 #include <assert.h>
 
 #include <list>
@@ -18,7 +17,13 @@
 #include <armadillo>  /* Matrix, vector library */
 #include "stream_based_al_random.h"
 #include "stream_based_al_data.h"
+#include "stream_based_al_instrumentation.h"
+#include "stream_based_al_histogram.h"
+#include "stream_based_al_block_kernels.h"
+#include "stream_based_al_epoch.h"
 #include <limits>
+#include <stdlib.h>  /* posix_memalign */
+#include <string.h>  /* memcpy */
 
 /* Boost libraries for serialization */
 #include <boost/archive/tmpdir.hpp>
@@ -30,8 +35,9 @@
 #include <boost/serialization/assume_abstract.hpp>
 
 /*---------------------------------------------------------------------------*/
-// Forward declaration of external random number generator
-extern RandomGenerator rng;
+// Forward declaration of external random number generator (one per thread,
+// so forests can be updated on different threads)
+extern thread_local RandomGenerator rng;
 
 /*---------------------------------------------------------------------------*/
 // TODO: serialization only works for Mondrian Block
@@ -49,14 +55,51 @@ namespace boost {
     }
 }
 
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns true if debug output is enabled. The debug output is only
+ * compiled in with STREAM_BASED_AL_DEBUG (make DEBUG_OUTPUT=1), otherwise
+ * this is a constant and the compiler removes all debug branches.
+ */
+inline bool debug_output(bool debug) {
+#ifdef STREAM_BASED_AL_DEBUG
+    return debug;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Invariant checks that scan whole vectors on every node visit. They are
+ * only compiled in for the checked build (make checked); the other builds
+ * can validate the complete tree every "validate_interval" samples instead
+ * (see MondrianTree::validate_tree).
+ */
+#ifdef STREAM_BASED_AL_CHECKED
+#define MF_CHECK(expr) assert(expr)
+#else
+#define MF_CHECK(expr) ((void) 0)
+#endif
+
 /*---------------------------------------------------------------------------*/
 /**
  * Settings to initialize a Mondrian tree
  *
  * @param num_trees         : number of trees in a Mondrian forest
- * @param init_budget       : init budget for lifetime parameter
+ * @param init_budget       : init budget for lifetime parameter (budget of
+ *                            the root node, infinity = unbounded lifetime)
  * @param discount_factor   :
  * @param debug             : set debug mode
+ * @param validate_interval : validate trees every n-th sample (0 = never)
+ * @param memory_budget     : memory ceiling of a forest in bytes
+ *                            (0 = unbounded)
+ * @param forget_half_life  : counts of the nodes are halved every n-th
+ *                            sample of a tree (0 = no forgetting)
+ * @param num_shards        : trees are split into this many shards, every
+ *                            sample updates the trees of one shard
+ *                            (1 = every tree learns every sample)
+ * @param shard_mode        : assignment of samples to shards
+ *                            (0 = round robin, 1 = hash of the features)
  */
 struct mondrian_settings {
     int num_trees;
@@ -68,6 +111,11 @@ struct mondrian_settings {
     int max_samples_in_one_node;
     int confidence_measure;
     float density_exponent;
+    int validate_interval;
+    long memory_budget;
+    int forget_half_life;
+    int num_shards;
+    int shard_mode;
 };
 /*---------------------------------------------------------------------------*/
 /**
@@ -79,13 +127,98 @@ struct mondrian_confidence {
     float distance;
 };
 /*---------------------------------------------------------------------------*/
+/**
+ * Size and memory statistics of a Mondrian tree
+ *
+ * The statistics are maintained incrementally whenever nodes are created,
+ * split or deleted. Only the leaf depths are collected on request by
+ * walking the tree (nodes do not store their depth).
+ */
+struct mondrian_tree_stats {
+    long num_nodes;  /**< Number of nodes */
+    long num_leaves;  /**< Number of leaf nodes */
+    long num_paused_leaves;  /**< Leaves with identical labels */
+    vector<long> leaf_depths;  /**< Number of leaves at each depth */
+    long bytes_nodes;  /**< Memory of node and block objects */
+    long bytes_bounds;  /**< Memory of block boundaries */
+    long bytes_histograms;  /**< Memory of label histograms */
+    long bytes_pred_prob;  /**< Memory of pred_prob_ vectors */
+    long bytes_paused_leaves;  /**< Memory held by paused leaves (part of
+                                 the values above) */
+    long num_collapsed;  /**< Internal nodes turned into leaves by the
+                           memory governor */
+    long bytes_collapsed;  /**< Memory released by collapsed nodes */
+    long num_forgotten;  /**< Nodes removed because their counts decayed
+                           to zero */
+
+    mondrian_tree_stats();
+    /**
+     * Count a leaf at a given depth
+     */
+    void add_leaf_depth(int depth);
+    /**
+     * Maximum depth of a leaf
+     */
+    inline int max_depth() const {
+        return leaf_depths.empty() ? 0 : int(leaf_depths.size()) - 1;
+    }
+    /**
+     * Total memory of all nodes
+     */
+    inline long total_bytes() const {
+        return bytes_nodes + bytes_bounds + bytes_histograms + bytes_pred_prob;
+    }
+    mondrian_tree_stats& operator+=(const mondrian_tree_stats& other);
+    /**
+     * Print statistics
+     */
+    void print(ostream& os) const;
+};
+/*---------------------------------------------------------------------------*/
+/**
+ * Contribution of a single node to the statistics of its tree
+ */
+struct mondrian_node_footprint {
+    bool counted;  /**< Node is counted in the statistics */
+    bool leaf;  /**< Node is counted as leaf */
+    bool paused;  /**< Node is counted as paused leaf */
+    long node_bytes;  /**< Memory of node and block object */
+    long bounds_bytes;  /**< Memory of block boundaries */
+    long hist_bytes;  /**< Memory of label histogram */
+    long pred_bytes;  /**< Memory of pred_prob_ */
+};
+/*---------------------------------------------------------------------------*/
+class MondrianTree; //Forward declaration of MondrianTree
+class MondrianNode; //Forward declaration of MondrianNode
+
+/**
+ * Internal node whose children are both leaves, i.e. a subtree the memory
+ * governor can collapse into a leaf
+ */
+struct mondrian_twig {
+    float expected_prob_mass;  /**< Expected probability mass of the node */
+    MondrianTree* tree;  /**< Tree of the node */
+    MondrianNode* node;  /**< Internal node */
+
+    /**
+     * Order by expected probability mass (least valuable first)
+     */
+    inline bool operator<(const mondrian_twig& other) const {
+        return expected_prob_mass < other.expected_prob_mass;
+    };
+};
+/*---------------------------------------------------------------------------*/
 /**
  * Defines a Mondrian block
  *
  * @param feature_dim_    : Dimension of feature vector
- * @param min_block_dim_  : Dimension-wise min of training data in current block
- * @param max_block_dim_  : Dimension-wise max of training data in current block
+ * @param bounds_        : Dimension-wise min and max of training data in
+ *                          current block
  * @param sum_range_dim_  : Sum of range of all dimensions
+ * @param kernels_        : Block kernels specialized for feature_dim_
+ *
+ * Both boundaries are stored in one aligned array (padded to
+ * "block_padding" floats), so the kernels work on contiguous memory.
  */
 class MondrianBlock {
     
@@ -93,7 +226,7 @@ public:
     /**
      * Construct mondrian block
      */
-    MondrianBlock() : feature_dim_(1) {};
+    MondrianBlock();
     MondrianBlock(const int& feature_dim,
                   const mondrian_settings& settings);
     MondrianBlock(const int& feature_dim,  /* Feature dimension */
@@ -114,6 +247,15 @@ public:
      * Get dimension range
      */
     float get_sum_dim_range(const arma::fvec& cur_sample);
+    /**
+     * Get linear distance of sample to the block (\eta_j(x))
+     */
+    inline float get_outside_sum(const arma::fvec& cur_sample) const;
+    /**
+     * Get euclidean distance of sample to the upper plus the distance to
+     * the lower block boundary
+     */
+    inline float get_outside_distance(const arma::fvec& cur_sample) const;
     /**
      * Get lower block boundary
      */
@@ -135,8 +277,16 @@ public:
      * Get sum_dim_range
      */
     inline float get_sum_dim_range();
+    /**
+     * Memory of the block boundaries in bytes
+     */
+    inline long bounds_bytes() const;
     
 private:
+    /* Block owns the boundary array (no copies) */
+    MondrianBlock(const MondrianBlock&);
+    MondrianBlock& operator=(const MondrianBlock&);
+
     /* Set functions ostream and serialization as friend */
     friend std::ostream & operator<<(std::ostream &os,
                                      const MondrianBlock &mb);
@@ -146,13 +296,34 @@ private:
     float sum_dim_range_;  /**< Sum of range of all dimensions */
     /**
      * Every Mondrian block has a lower and upper boundary
-     * in each dimension.
+     * in each dimension: the dimension-wise minimum of the training data
+     * (left border) is followed by the maximum (right border, at
+     * padded_dim()). Extending the block publishes a new array, so
+     * concurrent readers always see consistent borders.
      */
-    arma::fvec min_block_dim_;  /**< Dimension-wise minimum of training
-                                 data in current block (left border) */
-    arma::fvec max_block_dim_;  /**< Dimension-wise maximum of training
-                                 data in current block (right border) */
+    atomic_ptr<float> bounds_;
+    const block_kernels* kernels_;  /**< Kernels of feature dimension */
     bool debug_;  /**< Debug mode */
+    /**
+     * Allocate aligned boundary array of both borders (padding is zero)
+     */
+    float* allocate_bounds() const;
+    /**
+     * Boundary array to extend (copy of the current array, or the current
+     * array itself during an update without concurrent readers)
+     */
+    float* copy_bounds() const;
+    /**
+     * Publish extended boundaries and retire the old array
+     */
+    void publish_bounds(float* bounds);
+    /**
+     * Number of floats of one border (feature dimension with padding)
+     */
+    inline int padded_dim() const {
+        return (feature_dim_ + block_padding - 1) / block_padding *
+            block_padding;
+    };
     /**
      * Calculate sum of all dimension = sum(max_block_dim_ - min_block_dim_)
      */
@@ -165,10 +336,10 @@ private:
         //ar & boost::serialization::make_array(&min_block_dim_, feature_dim_);
         ar & const_cast<int &> (feature_dim_);
         ar & sum_dim_range_;
-        min_block_dim_.resize(feature_dim_);
-        max_block_dim_.resize(feature_dim_);
-        ar & min_block_dim_;
-        ar & max_block_dim_;
+        float* bounds = bounds_;
+        ar & boost::serialization::make_array(bounds, feature_dim_);
+        ar & boost::serialization::make_array(bounds + padded_dim(),
+                                              feature_dim_);
         ar & debug_;
     }
     
@@ -185,13 +356,33 @@ inline int MondrianBlock::get_feature_dim() {
  * Get lower block boundary
  */
 inline arma::fvec MondrianBlock::get_min_block_dim() {
-    return min_block_dim_;
+    return arma::fvec(bounds_.load(), feature_dim_);
 }
 /*
  * Get upper block boundary
  */
 inline arma::fvec MondrianBlock::get_max_block_dim() {
-    return max_block_dim_;
+    return arma::fvec(bounds_.load() + padded_dim(), feature_dim_);
+}
+
+/*
+ * Get linear distance of sample to the block
+ */
+inline float MondrianBlock::get_outside_sum(
+        const arma::fvec& cur_sample) const {
+    const float* bounds = bounds_;
+    return kernels_->outside_sum(bounds, bounds + padded_dim(),
+                                 cur_sample.memptr(), feature_dim_);
+}
+
+/*
+ * Get euclidean distance of sample to the block boundaries
+ */
+inline float MondrianBlock::get_outside_distance(
+        const arma::fvec& cur_sample) const {
+    const float* bounds = bounds_;
+    return kernels_->outside_distance(bounds, bounds + padded_dim(),
+                                      cur_sample.memptr(), feature_dim_);
 }
 
 /*
@@ -201,7 +392,12 @@ inline float MondrianBlock::get_sum_dim_range() {
     return sum_dim_range_;
 }
 
-class MondrianTree; //Forward declaration of MondrianTree
+/*
+ * Memory of the block boundaries
+ */
+inline long MondrianBlock::bounds_bytes() const {
+    return 2 * padded_dim() * sizeof(float);
+}
 
 /*---------------------------------------------------------------------------*/
 /**
@@ -225,11 +421,11 @@ public:
     /**
      * Construct tree node
      */
-    MondrianNode() : settings_(NULL) {};
-    MondrianNode(MondrianTree& mondrian_tree, int* num_classes,
+    MondrianNode() : pred_prob_(NULL), discount_(0.), posterior_dirty_(true),
+        settings_(NULL), decay_epoch_(0) {};
+    MondrianNode(MondrianTree& mondrian_tree, relaxed<int>* num_classes,
                  const int& feature_dim, const float& budget,
-                 MondrianNode& parent_node, const mondrian_settings& settings,
-                 int& depth);
+                 MondrianNode& parent_node, const mondrian_settings& settings);
     /**
      * Construct tree node with given values of boundaries of
      * the Mondrian block
@@ -237,11 +433,11 @@ public:
      * @param min_block_dim : Lower boundary of Mondrian block
      * @param max_block_dim : Upper boundary of Mondrian block
      */
-    MondrianNode(MondrianTree& mondrian_tree, int* num_classes,
+    MondrianNode(MondrianTree& mondrian_tree, relaxed<int>* num_classes,
                  const int& feature_dim, const float& budget,
                  MondrianNode& parent_node,
                  arma::fvec& min_block_dim, arma::fvec& max_block_dim,
-                 const mondrian_settings& settings, int& depth);
+                 const mondrian_settings& settings);
     /**
      * Construct tree node with given values of boundaries of
      * the Mondrian block and one existing child node
@@ -252,25 +448,33 @@ public:
      * @param min_block_dim     : Lower boundary of Mondrian block
      * @param max_block_dim     : Upper boundary of Mondrian block
      */
-    MondrianNode(MondrianTree& mondrian_tree, int* num_classes,
+    MondrianNode(MondrianTree& mondrian_tree, relaxed<int>* num_classes,
                  const int& feature_dim, const float& budget,
                  MondrianNode& parent_node,
                  MondrianNode& left_child_node, MondrianNode& right_child_node,
                  arma::fvec& min_block_dim, arma::fvec& max_block_dim,
-                 const mondrian_settings& settings, int& depth);
+                 const mondrian_settings& settings);
+    /**
+     * Construct tree node from a snapshot written by save() (the child
+     * nodes are linked by MondrianTree::load, "valid" is cleared if the
+     * stream is short or inconsistent)
+     */
+    MondrianNode(MondrianTree& mondrian_tree, relaxed<int>* num_classes,
+                 const int& feature_dim, MondrianNode& parent_node,
+                 const mondrian_settings& settings, istream& is,
+                 bool& valid);
     ~MondrianNode();
     /**
-     * Print information of current node
+     * Print information of current node and all nodes below
      */
     void print_info();
     /**
-     * Update histogram with additional class and
-     * increase class histogram +1 (add new class)
-     * - Updates child nodes too
+     * Return histogram with one entry per known class
+     * (classes that have not been seen at this node are zero)
      */
-    void add_new_class();
+    arma::Col<arma::uword> get_count_labels() const;
     /**
-     * Predict class of current sample
+     * Predict class of current sample (walks down the path of the sample)
      */
     int classify(Sample& sample, arma::fvec& pred_prob,
                       float& prob_not_separated_yet, mondrian_confidence& m_conf);
@@ -298,7 +502,111 @@ public:
      * children based on the parameters of the decision distribution.
      */
     void update_expected_prob_mass();
+    /**
+     * Update the expected probability mass of the current node only
+     */
     void update_expected_prob_mass(bool is_left);
+    /**
+     * Add the depths of all leaves below the current node to "stats"
+     *
+     * @param depth     : Depth of the current node
+     */
+    void collect_leaf_depths(mondrian_tree_stats& stats, int depth) const;
+    /**
+     * Add all internal nodes below the current node whose children are
+     * both leaves to "twigs" (the current node is not added)
+     */
+    void collect_twigs(vector<MondrianNode*>& twigs) const;
+    /**
+     * Turn the current node (internal, both children are leaves) into a
+     * leaf and retire the child nodes
+     */
+    void collapse();
+    /**
+     * Add all internal nodes below and including the current node with at
+     * least one forgotten leaf as child to "nodes"
+     */
+    void collect_forgotten_parents(vector<MondrianNode*>& nodes);
+    /**
+     * Returns true if the node is a leaf whose counts decayed to zero
+     */
+    bool is_forgotten() const;
+    /**
+     * Remove the current node and its forgotten leaf "child": the sibling
+     * of "child" takes the place of the current node
+     *
+     * @return          : Sibling node
+     */
+    MondrianNode* remove_child(MondrianNode& child);
+    /**
+     * Apply the halvings of the counts that are due since the node was
+     * visited last (forgetting)
+     */
+    void decay_counts();
+    /**
+     * Check invariants of the current node (bounds, split, links to
+     * children, decision distribution, posterior) and print every
+     * violation. The checked build also compares the cached posterior with
+     * recompute_posterior().
+     *
+     * @return          : Number of violated invariants
+     */
+    int validate_node() const;
+    /**
+     * Check invariants of the current node and all nodes below
+     *
+     * @param num_nodes     : Increased by the number of visited nodes
+     * @param num_leaves    : Increased by the number of visited leaves
+     * @return              : Number of violated invariants
+     */
+    int validate_subtree(long& num_nodes, long& num_leaves) const;
+    /**
+     * Recompute discount and cached posterior (pred_prob_) of the current
+     * node from its histogram and the posterior of the parent
+     *
+     * @return          : True if the posterior changed (the posteriors of
+     *                    the child nodes have to be updated as well)
+     */
+    bool update_posterior();
+    /**
+     * Returns true if the posterior was not computed yet
+     */
+    inline bool posterior_dirty() const {return posterior_dirty_;};
+    /**
+     * Child node on the path of "x" (internal nodes only)
+     */
+    inline MondrianNode* get_child_node(const arma::fvec& x) const {
+        return x[split_dim_] <= split_loc_ ? id_left_child_node_ :
+            id_right_child_node_;
+    };
+    inline MondrianNode* get_left_child_node() const {
+        return id_left_child_node_;
+    };
+    inline MondrianNode* get_right_child_node() const {
+        return id_right_child_node_;
+    };
+    /**
+     * Write the state of the current node (without the child nodes) to a
+     * snapshot
+     */
+    void save(ostream& os) const;
+    /**
+     * Link child node of a node loaded from a snapshot
+     */
+    inline void link_child_node(MondrianNode& child_node, bool is_left_node) {
+        if (is_left_node)
+            id_left_child_node_ = &child_node;
+        else
+            id_right_child_node_ = &child_node;
+    };
+    /**
+     * Returns true if the node is a leaf
+     */
+    inline bool is_leaf() const {return is_leaf_;};
+    /**
+     * Expected probability mass of the node
+     */
+    inline float get_expected_prob_mass() const {return expected_prob_mass_;};
     
 private:
     /**< Set functions ostream and serialization as friend */
@@ -306,35 +614,80 @@ private:
                                      const MondrianNode &mn);
     friend class boost::serialization::access;  /**< Serialization */
     
-    int* num_classes_;  /**< Number of classes */
-    float data_counter_;  /**< Count data points */
-    bool is_leaf_;  /**< Boolean variable to indicate if current node
-                     is a leaf node */
-    int split_dim_; /**< Split dimension (feat_id_chosen) */
-    float split_loc_; /**< Split location (split_chosen) */
-    float max_split_costs_; /**< Maximum split cost for a node ist time of
+    relaxed<int>* num_classes_;  /**< Number of classes */
+    relaxed<float> data_counter_;  /**< Count data points */
+    atomic<bool> is_leaf_;  /**< Boolean variable to indicate if current
+                             node is a leaf node (cleared after the child
+                             nodes are linked) */
+    relaxed<int> split_dim_; /**< Split dimension (feat_id_chosen) */
+    relaxed<float> split_loc_; /**< Split location (split_chosen) */
+    relaxed<float> max_split_costs_; /**< Maximum split cost for a node ist time of
                              split of node - time of split of parent and
                              is drawn from an exponential */
-    arma::Col<arma::uword> count_labels_;  /**< Stores histogram of lavels
-                                            at each node */
+    LabelHistogram count_labels_;  /**< Stores histogram of lavels at each
+                                    node (only classes seen at the node,
+                                    missing classes are zero) */
     float budget_;  /**< Represent remaining budget of current node */
-    arma::fvec pred_prob_;
+    atomic_ptr<arma::fvec> pred_prob_;  /**< Posterior mean of the node,
+                                         i.e. the prior mean of the child
+                                         nodes: weights of the
+                                         classes seen followed by the
+                                         weight of the uniform
+                                         distribution over all classes,
+                                         so a new class does not change
+                                         it (see add_posterior). Kept up
+                                         to date by
+                                         MondrianTree::update_posteriors,
+                                         a changed posterior is published
+                                         as a new vector */
+    relaxed<float> discount_;  /**< Discount exp(-discount_param * max_split_costs_)
+                       of the cached posterior */
+    atomic<bool> posterior_dirty_;  /**< Posterior was not computed yet
+                                     (only set on new nodes, never again
+                                     once a posterior was published) */
     MondrianTree* mondrian_tree_;   /**< Pointer to the Mondrian tree */
     MondrianBlock* mondrian_block_;  /**< Pointer to mondrian block */
     /**
      * Pointer to child (left, right) and parent node
      */
-    MondrianNode* id_left_child_node_; /**< Pointer to left child node */
-    MondrianNode* id_right_child_node_; /**< Pointer to right child node */
-    MondrianNode* id_parent_node_; /**< Pointer to parent node */
+    atomic_ptr<MondrianNode> id_left_child_node_; /**< Pointer to left
+                                                    child node */
+    atomic_ptr<MondrianNode> id_right_child_node_; /**< Pointer to right
+                                                     child node */
+    atomic_ptr<MondrianNode> id_parent_node_; /**< Pointer to parent node */
     const mondrian_settings* settings_;  /**< Mondrian settings */
-    int depth_;  /**< Current depth of node in the tree */
     float decision_distr_param_alpha_; /**< Parameter alpha of the estimated
                                         decision distribution of the node */
     float decision_distr_param_beta_;  /**< Parameter beta of the estimated
                                         decision distribution of the node */
-    float expected_prob_mass_; /**< Expected probability mass of the node */
+    relaxed<float> expected_prob_mass_; /**< Expected probability mass of
+                                         the node */
     bool debug_;  /**< Set debug mode */
+    mondrian_node_footprint footprint_;  /**< Contribution to the statistics
+                                          of the tree */
+    unsigned long decay_epoch_;  /**< Decay epoch of the tree when the
+                                   counts were halved last */
+    
+    /**
+     * Update the statistics of the tree with the current state of the node
+     *
+     * @param remove    : Remove the node from the statistics
+     */
+    void account_stats(bool remove = false);
+    /**
+     * Print information of current node only
+     */
+    void print_node_info();
+    /**
+     * Add contribution of current node to the prediction of the sample
+     * and return the child node on the path of the sample (NULL at a leaf)
+     */
+    MondrianNode* classify_node(Sample& sample, arma::fvec& pred_prob,
+                                float& prob_not_separated_yet, mondrian_confidence& m_conf);
+    /**
+     * Number of classes with at least one data point at this node
+     */
+    int num_labels_seen() const;
     
     /**
      * Checks if all labels in a node are identical
@@ -374,7 +727,7 @@ private:
      * Compute left right statistic
      */
     std::pair<arma::fvec, arma::fvec> compute_left_right_statistics(
-                                                                    int& split_dim, float& split_loc, const arma::fvec& sample_x,
+                                                                    const int& split_dim, const float& split_loc, const arma::fvec& sample_x,
                                                                     arma::fvec min_cur_block, arma::fvec max_cur_block,
                                                                     bool left_split);
     /**
@@ -396,13 +749,38 @@ private:
      */
     arma::fvec get_prior_mean(arma::fvec& pred_prob_par);
     arma::fvec get_prior_mean();
+    /**
+     * Return the cached posterior of the node (the prior mean, computed
+     * into "tmp", while a concurrent update has not computed it yet)
+     */
+    const arma::fvec& get_posterior(arma::fvec& tmp);
+    /**
+     * Add "weight" times a posterior (weights of the classes seen and of
+     * the uniform distribution) to the probabilities of all classes
+     */
+    static void add_posterior(const arma::fvec& posterior, float weight,
+                              arma::fvec& pred_prob);
+    /**
+     * Returns true if two posteriors are equal (missing classes are zero)
+     */
+    static bool equal_posteriors(const arma::fvec& a, const arma::fvec& b);
     /**
      * Compute posterior mean
+     *
+     * @param tables    : Use one customer per class seen (internal nodes)
      */
     arma::fvec compute_posterior_mean_normalized_stable(
-                                                        arma::Col<arma::uword>& cnt, float& discount,
-                                                        arma::fvec& base);
-    void update_depth();
+                                                        const LabelHistogram& cnt, const float& discount,
+                                                        arma::fvec& base, bool tables = false) const;
+    /**
+     * Posterior of the node recomputed from the root down without cached
+     * posteriors (reference for the cache in the checked build)
+     */
+    arma::fvec recompute_posterior() const;
+    /**
+     * Compute depth of the node by walking up to the root
+     */
+    int get_depth() const;
     /**
      * Update split_cost
      */
@@ -412,6 +790,11 @@ private:
      * Extend mondrian block to include new training data
      */
     void extend_mondrian_block(const Sample& sample);
+    /**
+     * Extend mondrian block of current node and return the child node the
+     * sample has to be passed to (NULL if the update is finished)
+     */
+    MondrianNode* extend_mondrian_block_node(const Sample& sample);
     
     /**
      * Compute the posterior of the decision distribution at the current
@@ -434,6 +817,15 @@ private:
  * @param root_node_    : Pointer to root node of the tree
  * @param num_classes_  : Number of classes (different labels)
  * @param data_counter_ : Counts all data points that pass by
+ *
+ * One thread may update the tree while other threads classify samples:
+ * new nodes are linked only after they are completely initialized, and
+ * replaced posteriors and block boundaries are freed by the epoch manager
+ * once no reader can use them any more. A concurrent prediction sees every
+ * node either before or after the running update. Everything else readers
+ * load while the writer changes it (counts, splits, split costs,
+ * probability masses, number of classes) is a relaxed atomic: the values
+ * are never torn, but may belong to the state during the update.
  */
 class MondrianTree {
 public:
@@ -448,18 +840,80 @@ public:
     
     ~MondrianTree();
     
-    int num_classes_;  /**< Number of classes (different labels) */
+    relaxed<int> num_classes_;  /**< Number of classes (different labels) */
+    mondrian_counters counters_;  /**< Hot-path counters (only collected if
+                                   compiled with instrumentation) */
+    mondrian_tree_stats stats_;  /**< Size and memory statistics */
+    vector<MondrianNode*> node_stack_;  /**< Reusable stack for traversals
+                                         of the tree during updates */
     /**
      * Print information of tree and every node
      */
     void print_info();
+    /**
+     * Return size and memory statistics of the tree (the leaf depths are
+     * collected by walking the tree)
+     */
+    mondrian_tree_stats get_stats() const;
+    /**
+     * Check invariants of all nodes of the tree and of the statistics
+     * (expensive, walks the complete tree)
+     *
+     * @return          : Number of violated invariants
+     */
+    int validate_tree() const;
+    /**
+     * Add all internal nodes whose children are both leaves to "twigs"
+     * (the root node is never collapsed)
+     */
+    void collect_twigs(vector<mondrian_twig>& twigs);
+    /**
+     * Collapse a node found by collect_twigs into a leaf
+     *
+     * @return          : Memory released (bytes)
+     */
+    long collapse(MondrianNode& twig);
+    /**
+     * Number of half-lives of the counts since the start (forgetting)
+     */
+    inline unsigned long get_decay_epoch() const {return decay_epoch_;};
+    /**
+     * Number of samples the tree has learned
+     */
+    inline float get_data_counter() const {return data_counter_;};
+    /**
+     * Update the cached posteriors along the path of "sample" and in all
+     * subtrees whose prior mean changed
+     */
+    void update_posteriors(const Sample& sample);
+    
+    /**
+     * Write the tree (all nodes in preorder) to a snapshot
+     */
+    void save(ostream& os) const;
+    /**
+     * Replace the tree by a snapshot written by save() (the tree must not
+     * be used by other threads)
+     *
+     * @param version   : Version of the forest snapshot (the sample
+     *                    counter is stored since version 3)
+     * @return          : False if the snapshot is short or inconsistent
+     *                    (the tree is empty afterwards)
+     */
+    bool load(istream& is, uint32_t version);
     
     /**
      * Update current data point
      */
     void update(Sample& sample);
     /**
-     * Predict class of current sample
+     * Grow the number of classes to "num_classes" without a sample (the
+     * class was seen by another tree); O(1), the cached posteriors stay
+     * valid
+     */
+    void add_classes(int num_classes);
+    /**
+     * Predict class of current sample (may run concurrently with update)
      */
     int classify(Sample& sample, arma::fvec& pred_prob,
                       mondrian_confidence& m_conf);
@@ -471,13 +925,32 @@ public:
     
 private:
     
-    float data_counter_;  /**< Count data points */
-    MondrianNode* root_node_;  /**< Pointer to root node */
-    MondrianNode* max_prob_mass_leaf_;  /**< Pointer to leaf with maximum probability mass*/
+    relaxed<float> data_counter_;  /**< Count data points */
+    atomic_ptr<MondrianNode> root_node_;  /**< Pointer to root node */
+    atomic_ptr<MondrianNode> max_prob_mass_leaf_;  /**< Pointer to leaf with
+                                                     maximum probability
+                                                     mass */
     const mondrian_settings* settings_;  /**< Settings of Mondrian forest */
+    int feature_dim_;  /**< Dimension of feature vector */
+    unsigned long decay_epoch_;  /**< Half-lives of the counts since the
+                                   start (0 without forgetting) */
+    uint64_t num_samples_;  /**< Samples learned, clock of the decay epoch
+                              (data_counter_ is a float and stops
+                              counting at 2^24) */
+    /**
+     * Update the posteriors of the nodes in node_stack_ and of all nodes
+     * below whose prior mean changed
+     */
+    void update_pending_posteriors();
+    /**
+     * Remove the forgotten leaves (counts decayed to zero) together with
+     * their parent nodes
+     */
+    void prune_forgotten();
     /**
      * Update number of classes
      *  - increase variable num_classes_ +1
+     *  - O(1): histograms of the nodes grow when they see the new class
      */
     void update_class_numbers(Sample& sample);
     /*
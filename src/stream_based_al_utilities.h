@@ -24,6 +24,7 @@
 #include <fstream>
 #include <string.h>
 #include <list>
+#include "stream_based_al_epoch.h"
 
 
 using namespace std;
@@ -88,4 +89,37 @@ inline bool equal_elements(arma::fvec& prob) {
     }   
     return same;
 }
+
+/*
+ * Write "value" in binary form (native byte order, used for snapshots)
+ */
+template <typename T>
+inline void write_binary(ostream& os, const T& value) {
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/*
+ * Read "value" written by write_binary (returns false on a short read)
+ */
+template <typename T>
+inline bool read_binary(istream& is, T& value) {
+    is.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(is);
+}
+
+/*
+ * Values that concurrent readers load are written and read by value
+ */
+template <typename T>
+inline void write_binary(ostream& os, const relaxed<T>& value) {
+    write_binary(os, value.load());
+}
+
+template <typename T>
+inline bool read_binary(istream& is, relaxed<T>& value) {
+    T tmp = T();
+    bool valid = read_binary(is, tmp);
+    value = tmp;
+    return valid;
+}
 #endif /* STREAM_BASED_AL__UTILITIES_H_ */